@@ -24,6 +24,7 @@ int main(int argc, char** argv) {
 	const auto frag_count = parse_command_line_option(argc, argv, "--frag-count", 1024 * 1024 * 4 / 4);
 	const auto stride = parse_command_line_option(argc, argv, "--stride", 1024);
 	const int64_t repetitions = parse_command_line_option(argc, argv, "--reps", 10);
+	const int64_t pipeline_slots = parse_command_line_option(argc, argv, "--pipeline-slots", 0); // 0: no pipelining
 
 	auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
 	auto trg_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
@@ -58,14 +59,19 @@ int main(int argc, char** argv) {
 		COPYLIB_ENSURE(is_equivalent(set, spec), "Copy set generated does not implement spec:\nspec:{}\nset:{}\n", spec, set);
 	}
 
-	utils::print("Copying {} MB between devices, strided on both ends in a buffer of {} MB, {} repetitions\n", //
-	    source_layout.total_bytes() / 1024 / 1024, source_layout.total_extent() / 1024 / 1024, repetitions);
+	utils::print("Copying {} MB between devices, strided on both ends in a buffer of {} MB, {} repetitions{}\n", //
+	    source_layout.total_bytes() / 1024 / 1024, source_layout.total_extent() / 1024 / 1024, repetitions,
+	    pipeline_slots > 0 ? utils::format(", pipelined with {} staging slots", pipeline_slots) : "");
 
 	for(size_t p = 0; p < chunk_sizes.size(); p++) {
 		for(int64_t i = 0; i < repetitions; i++) {
 			exec.barrier();
 			auto start = clock::now();
-			execute_copy(exec, copy_sets[p]);
+			if(pipeline_slots > 0) {
+				execute_copy_pipelined(exec, copy_sets[p], pipeline_slots);
+			} else {
+				execute_copy(exec, copy_sets[p]);
+			}
 			exec.barrier();
 			auto end = clock::now();
 			durations[p].push_back(end - start);
@@ -18,14 +18,19 @@ int main(int argc, char** argv) {
 	const auto frag_length = parse_command_line_option(argc, argv, "--frag-length", 4);
 	const auto frag_count = parse_command_line_option(argc, argv, "--frag-count", 8192 * 4);
 	const auto stride = parse_command_line_option(argc, argv, "--stride", 2048 * 4);
+	// by default, the target is linear; a target stride makes it a strided-to-strided copy
+	const auto target_stride = parse_command_line_option(argc, argv, "--target-stride", frag_length);
 
+	auto q = exec.get_queue(device_id::d0);
+	// the staging buffer of the device is used by the staged copies, so the target needs to be separate
+	const auto trg_allocation = sycl::malloc_device<std::byte>(buffer_size, q);
 	auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
-	auto trg_buffer = reinterpret_cast<intptr_t>(exec.get_staging_buffer(device_id::d0));
+	auto trg_buffer = reinterpret_cast<intptr_t>(trg_allocation);
 
 	const data_layout strided_layout{src_buffer, 0, frag_length, frag_count, stride};
-	const data_layout linear_layout{trg_buffer, 0, strided_layout.fragment_length, strided_layout.fragment_count, strided_layout.fragment_length};
+	const data_layout target_strided_layout{trg_buffer, 0, strided_layout.fragment_length, strided_layout.fragment_count, target_stride};
 	const data_layout source_layout = strided_layout;
-	const data_layout target_layout = linear_layout;
+	const data_layout target_layout = target_strided_layout;
 
 	COPYLIB_ENSURE(source_layout.total_extent() <= buffer_size, "Buffer too small for source layout");
 	COPYLIB_ENSURE(target_layout.total_extent() <= buffer_size, "Buffer too small for target layout");
@@ -33,7 +38,6 @@ int main(int argc, char** argv) {
 	const copy_spec spec{device_id::d0, source_layout, device_id::d0, target_layout};
 	COPYLIB_ENSURE(is_valid(spec), "Invalid copy spec: {}", spec);
 
-	auto q = exec.get_queue(device_id::d0);
 	q.fill(reinterpret_cast<uint8_t*>(src_buffer), static_cast<uint8_t>(42), source_layout.total_extent()).wait_and_throw();
 
 	using clock = std::chrono::high_resolution_clock;
@@ -73,4 +77,32 @@ int main(int argc, char** argv) {
 		const auto gigabytes_per_second = total_gigabytes / time_seconds;
 		utils::print("{:12}: {:10.2f}us, {:10.2f} GB/s\n", prop_options[p], time_seconds * 1e6, gigabytes_per_second);
 	}
+
+	// with kernels, compare the direct copy between the layouts emitted by the planner with linearizing through a staging buffer
+	const copy_strategy kernel_strategy{copy_type::staged, copy_properties::use_kernel};
+	if(is_direct_kernel_copy(spec, kernel_strategy)) {
+		const std::vector<std::pair<std::string, copy_plan>> plans = {
+		    {"direct", manifest_strategy(spec, kernel_strategy, basic_staging_provider{}).front()},
+		    {"staged", apply_staging(spec, kernel_strategy, basic_staging_provider{})},
+		};
+		utils::print("\nKernel copies, direct between the layouts vs. staged:\n");
+		for(const auto& [name, plan] : plans) {
+			std::vector<std::chrono::high_resolution_clock::duration> plan_durations;
+			for(int64_t run = 0; run < runs; ++run) {
+				exec.barrier();
+				auto start = clock::now();
+				for(int64_t i = 0; i < repetitions; i++) {
+					execute_copy(exec, plan);
+				}
+				exec.barrier();
+				auto end = clock::now();
+				plan_durations.push_back((end - start) / repetitions);
+			}
+			const auto time_seconds = utils::vector_min(plan_durations) / 1.0s;
+			const auto gigabytes_per_second = spec.source_layout.total_bytes() / (1024.0 * 1024.0 * 1024.0) / time_seconds;
+			utils::print("{:12}: {:10.2f}us, {:10.2f} GB/s ({} step(s))\n", name, time_seconds * 1e6, gigabytes_per_second, plan.size());
+		}
+	}
+
+	sycl::free(trg_allocation, q);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
-#include "copylib_backend.hpp" // IWYU pragma: keep
-#include "copylib_core.hpp"    // IWYU pragma: keep
-#include "copylib_support.hpp" // IWYU pragma: keep
+#include "copylib_backend.hpp"   // IWYU pragma: keep
+#include "copylib_core.hpp"      // IWYU pragma: keep
+#include "copylib_file.hpp"      // IWYU pragma: keep
+#include "copylib_support.hpp"   // IWYU pragma: keep
+#include "copylib_transport.hpp" // IWYU pragma: keep
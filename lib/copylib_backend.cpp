@@ -1,5 +1,6 @@
 #include "copylib_backend.hpp"
 
+#include "copylib_host.hpp"
 #include "copylib_support.hpp" // IWYU pragma: keep - this is needed for formatting output, IWYU is dumb
 
 #ifdef SIMSYCL_VERSION
@@ -16,8 +17,18 @@
 #include <cuda_runtime.h>
 #endif
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
 #include <thread>
+#include <unordered_map>
 
 #include <bs_thread_pool/bs_thread_pool.hpp>
 
@@ -105,32 +116,90 @@ int32_t executor::get_preferred_wg_size() const {
 	return wg_size;
 }
 
-int get_cpu_for_gpu_alloc(int gpu_idx, size_t total_gpu_count) {
-	constexpr int max_gpu_idx = static_cast<int>(device_id::count);
-	COPYLIB_ENSURE(gpu_idx < max_gpu_idx && gpu_idx >= 0, "Invalid gpu index: {} (needs to be >=0 and <{})", gpu_idx, max_gpu_idx);
-	COPYLIB_ENSURE(total_gpu_count <= max_gpu_idx, "Invalid total gpu count: {} (needs to be <{})", total_gpu_count, max_gpu_idx);
-	thread_local bool initialized = false;
-	thread_local std::array<int, max_gpu_idx> cpu_for_gpu;
-	if(!initialized) {
-		auto env_var = std::getenv("COPYLIB_ALLOC_CPU_IDS");
-		if(env_var) {
-			const auto cpu_ids = std::string(env_var);
-			const auto cpu_ids_split = utils::split(cpu_ids, ',');
+fragment_class get_fragment_class(int64_t fragment_elements) {
+	if(fragment_elements <= 1) { return fragment_class::single_element; }
+	if(fragment_elements <= 64) { return fragment_class::short_fragments; }
+	return fragment_class::long_fragments;
+}
+
+int64_t get_representative_fragment_elements(fragment_class fragments) {
+	switch(fragments) {
+	case fragment_class::single_element: return 1;
+	case fragment_class::short_fragments: return 16;
+	default: return 256;
+	}
+}
+
+size_t kernel_tuning::get_element_size_index(int64_t element_size) {
+	const auto it = std::find(element_sizes.begin(), element_sizes.end(), element_size);
+	COPYLIB_ENSURE(it != element_sizes.end(), "Invalid element size for kernel copies: {}", element_size);
+	return it - element_sizes.begin();
+}
+
+const kernel_config& kernel_tuning::get(int64_t element_size, fragment_class fragments) const {
+	const auto& config = tuned[get_element_size_index(element_size)][static_cast<size_t>(fragments)];
+	return config.has_value() ? *config : default_config;
+}
+
+void kernel_tuning::set(int64_t element_size, fragment_class fragments, const kernel_config& config) {
+	COPYLIB_ENSURE(config.wg_size > 0 && config.items_per_thread > 0, "Invalid kernel config: wg size {}, {} item(s) per thread", config.wg_size,
+	    config.items_per_thread);
+	tuned[get_element_size_index(element_size)][static_cast<size_t>(fragments)] = config;
+}
+
+namespace {
+	// the PCI address of a device, if the SYCL implementation exposes it
+	std::string get_pci_address([[maybe_unused]] const sycl::device& dev) {
+#if defined(SYCL_EXT_INTEL_DEVICE_INFO) && SYCL_EXT_INTEL_DEVICE_INFO >= 5
+		if(dev.has(sycl::aspect::ext_intel_pci_address)) { return dev.get_info<sycl::ext::intel::info::device::pci_address>(); }
+#endif
+#if ACPP_WITH_CUDA
+		if(dev.get_backend() == sycl::backend::cuda) {
+			char bus_id[32] = {};
+			if(cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), sycl::get_native<sycl::backend::cuda>(dev)) == cudaSuccess) { return bus_id; }
+		}
+#endif
+		return {};
+	}
+
+	// the CPU on which host buffers for the given GPU are allocated: as specified in COPYLIB_ALLOC_CPU_IDS, or one local to the GPU
+	int get_cpu_for_gpu_alloc(int gpu_idx, size_t total_gpu_count, const pci_device_locality& locality) {
+		if(const auto env_var = std::getenv("COPYLIB_ALLOC_CPU_IDS")) {
+			const auto cpu_ids_split = utils::split(std::string(env_var), ',');
 			COPYLIB_ENSURE(cpu_ids_split.size() >= total_gpu_count, "Insufficient number of CPU IDs provided in COPYLIB_ALLOC_CPU_IDS: {} (expected {})",
 			    cpu_ids_split.size(), total_gpu_count);
-			for(size_t i = 0; i < total_gpu_count; i++) {
-				cpu_for_gpu[i] = std::stoi(cpu_ids_split[i]);
-			}
-		} else { // guess
-			const auto hw_concurrency = std::thread::hardware_concurrency();
-			const auto cores = hw_concurrency / 2; // we just assume 2 threads per core
-			for(size_t i = 0; i < total_gpu_count; i++) {
-				cpu_for_gpu[i] = cores / total_gpu_count * i;
+			return std::stoi(cpu_ids_split[gpu_idx]);
+		}
+		// GPUs sharing a node get different CPUs of that node
+		if(!locality.local_cpus.empty()) { return locality.local_cpus[gpu_idx % locality.local_cpus.size()]; }
+		// without locality information, spread the GPUs across the NUMA nodes
+		std::vector<std::vector<int>> nodes;
+		for(auto& cpus : get_numa_node_cpus()) {
+			if(!cpus.empty()) { nodes.push_back(std::move(cpus)); }
+		}
+		return nodes[gpu_idx * nodes.size() / total_gpu_count].front();
+	}
+
+	// the GPUs an executor can use; with COPYLIB_PARTITION_DEVICES set, partitionable GPUs (e.g. multi-tile ones) are replaced by their sub-devices,
+	// which are then planned and scheduled as devices of their own
+	std::vector<sycl::device> get_gpu_devices() {
+		auto gpus = sycl::device::get_devices(sycl::info::device_type::gpu);
+		if(std::getenv("COPYLIB_PARTITION_DEVICES") == nullptr) { return gpus; }
+		std::vector<sycl::device> ret;
+		for(const auto& gpu : gpus) {
+			const auto domains = gpu.get_info<sycl::info::device::partition_affinity_domains>();
+			if(gpu.get_info<sycl::info::device::partition_max_sub_devices>() > 1
+			    && std::find(domains.begin(), domains.end(), sycl::info::partition_affinity_domain::next_partitionable) != domains.end()) {
+				const auto sub_devices = gpu.create_sub_devices<sycl::info::partition_property::partition_by_affinity_domain>(
+				    sycl::info::partition_affinity_domain::next_partitionable);
+				ret.insert(ret.end(), sub_devices.begin(), sub_devices.end());
+			} else {
+				ret.push_back(gpu);
 			}
 		}
+		return ret;
 	}
-	return cpu_for_gpu[gpu_idx];
-}
+} // namespace
 
 std::string executor::get_info() const {
 	auto ret = utils::format("Copylib executor with {} device(s) and buffer size {} bytes\n", devices.size(), buffer_size);
@@ -138,10 +207,21 @@ std::string executor::get_info() const {
 	ret += utils::format("2D copy: {}    D2D copy: {}    Peer access: {}    Preferred wg size: {}\n", //
 	    is_2d_copy_available(), is_device_to_device_copy_available(), is_peer_memory_access_available(), get_preferred_wg_size());
 	ret += utils::format("Using {} queues per device\n", get_queues_per_device());
+	ret += utils::format("Host copy engine: {} thread(s) on {} NUMA node(s), {} pack/unpack\n", host_copies->get_thread_count(), host_copies->get_numa_node_count(),
+	    get_host_simd_level_name(get_host_simd_level()));
+	std::lock_guard lock(buffer_mutex);
 	for(size_t i = 0; i < devices.size(); i++) {
+		const auto& dev = devices[i];
 		ret += utils::format("    Device {:2}: {} [{}]", i, //
 		    gpu_devices[i].get_info<sycl::info::device::name>(), gpu_devices[i].get_info<sycl::info::device::vendor>());
-		ret += utils::format(" (host alloc on core {})\n", get_cpu_for_gpu_alloc(i, devices.size()));
+		ret += utils::format(" (PCI {}, NUMA node {}, local CPUs {}; host alloc on core {})\n", dev.locality.pci_address.empty() ? "unknown" : dev.locality.pci_address,
+		    dev.locality.numa_node, dev.locality.local_cpus.empty() ? "unknown" : format_cpu_list(dev.locality.local_cpus), dev.host_alloc_cpu);
+		const auto placement_info = [&](const char* name, const std::byte* buffer, const device::host_placement& placement) {
+			if(buffer == nullptr) { return utils::format("{} not allocated", name); }
+			return utils::format("{} {}bound, {:.0f}% of sampled pages local", name, placement.bound ? "" : "not ", placement.fraction_local * 100);
+		};
+		ret += utils::format("                Host buffers on NUMA node {}: {}; {}\n", dev.host_numa_node, placement_info("buffer", dev.host_buffer, dev.host_buffer_placement),
+		    placement_info("staging buffer", dev.host_staging_buffer, dev.host_staging_buffer_placement));
 	}
 	return ret;
 }
@@ -176,9 +256,11 @@ void executor::barrier() {
 	}
 }
 
-executor::executor(int64_t buffer_size) : executor(buffer_size, sycl::device::get_devices(sycl::info::device_type::gpu).size(), 1) {}
+executor::executor(int64_t buffer_size) : executor(buffer_size, get_gpu_devices().size(), 1) {}
 
-executor::executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_per_device) : buffer_size(buffer_size) {
+executor::executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_per_device, buffer_init host_buffer_init)
+    : buffer_size(buffer_size), host_buffer_init(host_buffer_init), host_copies(std::make_unique<host_copy_engine>()), staging(std::make_unique<staging_pool>()),
+      scheduler(std::make_unique<work_stealing_scheduler>(queues_per_device)) {
 	COPYLIB_ENSURE(devices_needed > 0, "Need at least one device");
 	COPYLIB_ENSURE(queues_per_device > 0, "Need at least one queue per device");
 
@@ -190,19 +272,13 @@ executor::executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_p
 	simsycl::configure_system(sys_cfg);
 #endif
 
-	const int64_t total_bytes = buffer_size;
-
-	gpu_devices = sycl::device::get_devices(sycl::info::device_type::gpu);
+	gpu_devices = get_gpu_devices();
 	if(gpu_devices.size() < static_cast<size_t>(devices_needed)) {
 		COPYLIB_ERROR("Not enough GPU devices available: {} ({} needed)", gpu_devices.size(), devices_needed);
 	} else if(gpu_devices.size() > static_cast<size_t>(devices_needed)) {
 		gpu_devices.resize(devices_needed); // don't waste time initializing more devices than needed
 	}
-	cpu_set_t prior_mask;
-	CPU_ZERO(&prior_mask);
-	COPYLIB_ENSURE(pthread_getaffinity_np(pthread_self(), sizeof(prior_mask), &prior_mask) == 0, "Failed to get CPU affinity");
-
-	// allocate queues and device buffers
+	// create queues; buffers are only allocated once they are used
 	devices.reserve(gpu_devices.size());
 	int dev_id = 0;
 	for(const auto& device : gpu_devices) {
@@ -223,32 +299,15 @@ executor::executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_p
 			queues.emplace_back(sycl::queue(device, queue_properties));
 		}
 		auto& dev = devices.emplace_back(device, queues);
-		auto& q = dev.queues[0];
-
-		dev.dev_buffer = sycl::malloc_device<std::byte>(total_bytes, q);
-		dev.staging_buffer = sycl::malloc_device<std::byte>(total_bytes, q);
-		COPYLIB_ENSURE(dev.dev_buffer != nullptr, "Failed to allocate device buffer");
-		COPYLIB_ENSURE(dev.staging_buffer != nullptr, "Failed to allocate device staging buffer");
-
-		cpu_set_t mask_for_device;
-		CPU_ZERO(&mask_for_device);
-		const auto cpu_id = get_cpu_for_gpu_alloc(dev_id, gpu_devices.size());
-		CPU_SET(cpu_id, &mask_for_device);
-		COPYLIB_ENSURE(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask_for_device) == 0, "Failed to set CPU affinity");
-
-		dev.host_buffer = sycl::malloc_host<std::byte>(total_bytes, q);
-		dev.host_staging_buffer = sycl::malloc_host<std::byte>(total_bytes, q);
-		COPYLIB_ENSURE(dev.host_buffer != nullptr, "Failed to allocate host buffer");
-		COPYLIB_ENSURE(dev.host_staging_buffer != nullptr, "Failed to allocate host staging buffer");
-		// initialize data on host
-		for(int i = 0; i < total_bytes; i++) {
-			dev.host_buffer[i] = static_cast<std::byte>(i % 256);
-			dev.host_staging_buffer[i] = static_cast<std::byte>(i % 256);
-		}
-
+		dev.locality = get_pci_device_locality(get_pci_address(device));
+		dev.host_alloc_cpu = get_cpu_for_gpu_alloc(dev_id, gpu_devices.size(), dev.locality);
+		dev.host_numa_node = dev.locality.numa_node >= 0 ? dev.locality.numa_node : get_numa_node_of_cpu(dev.host_alloc_cpu);
+		const auto did = make_device_id(dev_id);
+		staging->add_buffer(did, false, buffer_size, [this, did] { return get_staging_buffer(did); });
+		staging->add_buffer(did, true, buffer_size, [this, did] { return get_host_staging_buffer(did); });
 		dev_id++;
 	}
-	COPYLIB_ENSURE(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &prior_mask) == 0, "Failed to reset CPU affinity");
+	reset_kernel_tuning();
 } // namespace copylib
 
 device::~device() {
@@ -270,83 +329,272 @@ sycl::queue& executor::get_queue(device_id id, int64_t queue_idx) {
 	return queues[queue_idx];
 }
 
-std::byte* executor::get_buffer(device_id id) {
+std::byte* executor::get_or_allocate_buffer(device_id id, buffer_role role) {
 	COPYLIB_ENSURE(static_cast<int>(id) >= 0 && static_cast<size_t>(id) < devices.size(), "Invalid device id: {} ({} device(s) available)", id, devices.size());
-	return devices[static_cast<int>(id)].dev_buffer;
+	const int dev_id = static_cast<int>(id);
+	auto& dev = devices[dev_id];
+	std::byte*& buffer = [&]() -> std::byte*& {
+		switch(role) {
+		case buffer_role::device: return dev.dev_buffer;
+		case buffer_role::device_staging: return dev.staging_buffer;
+		case buffer_role::host: return dev.host_buffer;
+		case buffer_role::host_staging: return dev.host_staging_buffer;
+		}
+		COPYLIB_ERROR("Invalid buffer role");
+	}();
+
+	std::lock_guard lock(buffer_mutex);
+	if(buffer != nullptr) { return buffer; }
+	auto& q = dev.queues[0];
+	if(role == buffer_role::device || role == buffer_role::device_staging) {
+		buffer = sycl::malloc_device<std::byte>(buffer_size, q);
+		COPYLIB_ENSURE(buffer != nullptr, "Failed to allocate {}buffer on device {}", role == buffer_role::device_staging ? "staging " : "", id);
+		registry.add({reinterpret_cast<intptr_t>(buffer), buffer_size, id, memory_kind::device});
+		return buffer;
+	}
+
+	// host buffers are allocated with the current thread pinned to a CPU close to the device, which suffices if the runtime places pages on allocation
+	cpu_set_t prior_mask;
+	CPU_ZERO(&prior_mask);
+	COPYLIB_ENSURE(pthread_getaffinity_np(pthread_self(), sizeof(prior_mask), &prior_mask) == 0, "Failed to get CPU affinity");
+	cpu_set_t mask_for_device;
+	CPU_ZERO(&mask_for_device);
+	CPU_SET(dev.host_alloc_cpu, &mask_for_device);
+	COPYLIB_ENSURE(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask_for_device) == 0, "Failed to set CPU affinity");
+	buffer = sycl::malloc_host<std::byte>(buffer_size, q);
+	COPYLIB_ENSURE(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &prior_mask) == 0, "Failed to reset CPU affinity");
+	COPYLIB_ENSURE(buffer != nullptr, "Failed to allocate host {}buffer for device {}", role == buffer_role::host_staging ? "staging " : "", id);
+	registry.add({reinterpret_cast<intptr_t>(buffer), buffer_size, device_id::host, memory_kind::host_pinned});
+
+	// otherwise (e.g. if the runtime allocates on another thread), binding moves the pages, and initialization places those not yet touched
+	auto& placement = role == buffer_role::host ? dev.host_buffer_placement : dev.host_staging_buffer_placement;
+	placement.bound = bind_to_numa_node(buffer, buffer_size, dev.host_numa_node);
+	host_copies->initialize(buffer, buffer_size, host_buffer_init, dev.host_numa_node);
+	placement.fraction_local = get_fraction_on_numa_node(buffer, buffer_size, dev.host_numa_node);
+	if(host_buffer_init != buffer_init::none && dev.host_numa_node >= 0 && placement.fraction_local < 1) {
+		utils::err_print("Warning: only {:.0f}% of the sampled pages of the host {}buffer for device {} reside on NUMA node {}\n", placement.fraction_local * 100,
+		    role == buffer_role::host_staging ? "staging " : "", id, dev.host_numa_node);
+	}
+	return buffer;
 }
-std::byte* executor::get_staging_buffer(device_id id) {
-	COPYLIB_ENSURE(static_cast<int>(id) >= 0 && static_cast<size_t>(id) < devices.size(), "Invalid device id: {} ({} device(s) available)", id, devices.size());
-	return devices[static_cast<int>(id)].staging_buffer;
+
+void executor::register_buffer(void* ptr, int64_t size, device_id did, memory_kind kind) {
+	const bool host_memory = kind == memory_kind::host_pinned || kind == memory_kind::host_pageable;
+	COPYLIB_ENSURE(host_memory == (did == device_id::host) || kind == memory_kind::shared, "Cannot register {} memory for {}", kind, did);
+	registry.add({reinterpret_cast<intptr_t>(ptr), size, did, kind});
 }
 
-std::byte* executor::get_host_buffer(device_id id) {
-	COPYLIB_ENSURE(static_cast<int>(id) >= 0 && static_cast<size_t>(id) < devices.size(), "Invalid device id: {} ({} device(s) available)", id, devices.size());
-	return devices[static_cast<int>(id)].host_buffer;
+void executor::unregister_buffer(void* ptr) { registry.remove(reinterpret_cast<intptr_t>(ptr)); }
+
+memory_kind executor::pin_host_buffer(void* ptr, int64_t size) {
+	auto kind = memory_kind::host_pageable;
+#if ACPP_WITH_CUDA
+	if(cudaHostRegister(ptr, size, cudaHostRegisterPortable) == cudaSuccess) { kind = memory_kind::host_pinned; }
+#elif defined(SYCL_EXT_ONEAPI_COPY_OPTIMIZE)
+	// the runtime transfers the memory without intermediate staging then, but kernels can not access it
+	for(const auto& dev : devices) {
+		sycl::ext::oneapi::experimental::prepare_for_device_copy(ptr, size, dev.queues.front().get_context());
+	}
+#endif
+	register_buffer(ptr, size, device_id::host, kind);
+	return kind;
+}
+
+void executor::unpin_host_buffer(void* ptr) {
+	const auto buffer = registry.find(reinterpret_cast<intptr_t>(ptr));
+	COPYLIB_ENSURE(buffer.has_value() && buffer->base == reinterpret_cast<intptr_t>(ptr) && buffer->did == device_id::host, "{} is not a pinned host buffer",
+	    ptr);
+#if ACPP_WITH_CUDA
+	if(buffer->kind == memory_kind::host_pinned) { cudaHostUnregister(ptr); }
+#elif defined(SYCL_EXT_ONEAPI_COPY_OPTIMIZE)
+	for(const auto& dev : devices) {
+		sycl::ext::oneapi::experimental::release_from_device_copy(ptr, dev.queues.front().get_context());
+	}
+#endif
+	unregister_buffer(ptr);
 }
-std::byte* executor::get_host_staging_buffer(device_id id) {
+
+memory_kind executor::get_memory_kind(const void* ptr, device_id did) const {
+	if(const auto buffer = registry.find(reinterpret_cast<intptr_t>(ptr))) { return buffer->kind; }
+	if(devices.empty()) { return did == device_id::host ? memory_kind::host_pageable : memory_kind::device; }
+	switch(sycl::get_pointer_type(ptr, devices.front().queues.front().get_context())) {
+	case sycl::usm::alloc::host: return memory_kind::host_pinned;
+	case sycl::usm::alloc::device: return memory_kind::device;
+	case sycl::usm::alloc::shared: return memory_kind::shared;
+	default: return did == device_id::host ? memory_kind::host_pageable : memory_kind::device;
+	}
+}
+
+kernel_config tune_kernel_copy(sycl::queue& q, std::byte* buffer, int64_t buffer_size, int64_t element_size, fragment_class fragments,
+    const std::vector<kernel_config>& candidates);
+
+const kernel_tuning& executor::get_kernel_tuning(device_id id) const {
 	COPYLIB_ENSURE(static_cast<int>(id) >= 0 && static_cast<size_t>(id) < devices.size(), "Invalid device id: {} ({} device(s) available)", id, devices.size());
-	return devices[static_cast<int>(id)].host_staging_buffer;
+	return devices[static_cast<int>(id)].tuning;
 }
 
-void copy_with_kernel(sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size);
+void executor::autotune_kernel_copies() {
+	// a work-group size forced by the environment is kept, only the items per thread are tuned then
+	std::vector<int32_t> wg_sizes = {32, 64, 128, 256};
+	if(std::getenv("COPYLIB_WG_SIZE") != nullptr) { wg_sizes = {get_preferred_wg_size()}; }
+	for(size_t i = 0; i < devices.size(); i++) {
+		const auto did = make_device_id(i);
+		auto& q = get_queue(did);
+		const auto max_wg_size = static_cast<int32_t>(q.get_device().get_info<sycl::info::device::max_work_group_size>());
+		std::vector<kernel_config> candidates;
+		for(const auto wg_size : wg_sizes) {
+			if(wg_size > max_wg_size) { continue; }
+			for(const int32_t items_per_thread : {1, 2, 4, 8}) {
+				candidates.push_back({wg_size, items_per_thread});
+			}
+		}
+		if(candidates.empty()) { continue; }
+		auto& tuning = devices[i].tuning;
+		for(const auto element_size : kernel_tuning::element_sizes) {
+			for(int fc = 0; fc < static_cast<int>(fragment_class::count); fc++) {
+				const auto fragments = static_cast<fragment_class>(fc);
+				tuning.set(element_size, fragments, tune_kernel_copy(q, get_buffer(did), buffer_size, element_size, fragments, candidates));
+			}
+		}
+	}
+}
 
-template <typename CopyFun>
-void copy_via_repeated_1D_copies(CopyFun fun, const data_layout& source_layout, const data_layout& target_layout) {
-	const auto larger_fragment_count = std::max(source_layout.fragment_count, target_layout.fragment_count);
-	const auto smaller_fragment_size = std::min(source_layout.fragment_length, target_layout.fragment_length);
-	for(int64_t frag = 0; frag < larger_fragment_count; ++frag) {
-		const auto src_factor = source_layout.fragment_length / smaller_fragment_size;
-		const auto tgt_factor = target_layout.fragment_length / smaller_fragment_size;
-		const auto src_fragment_id = frag / src_factor;
-		const auto tgt_fragment_id = frag / tgt_factor;
-		const auto src_offset_in_fragment = frag % src_factor * target_layout.fragment_length;
-		const auto src = source_layout.base_ptr() + source_layout.fragment_offset(src_fragment_id) + src_offset_in_fragment;
-		const auto tgt_offset_in_fragment = frag % tgt_factor * source_layout.fragment_length;
-		const auto tgt = target_layout.base_ptr() + target_layout.fragment_offset(tgt_fragment_id) + tgt_offset_in_fragment;
-		fun(src, tgt, smaller_fragment_size);
+void executor::reset_kernel_tuning() {
+	for(auto& dev : devices) {
+		dev.tuning = kernel_tuning({get_preferred_wg_size(), 1});
 	}
 }
 
-executor::target execute_copy(executor& exec, const copy_spec& spec, int64_t queue_idx, bool alternate_device, const executor::target last_target) {
-	constexpr bool debug = false;
-	const device_id last_device = last_target.did;
-	if(debug) utils::err_print("{}:\n  -> last_device is {}\n", spec, last_device);
+std::byte* executor::get_buffer(device_id id) { return get_or_allocate_buffer(id, buffer_role::device); }
+std::byte* executor::get_staging_buffer(device_id id) { return get_or_allocate_buffer(id, buffer_role::device_staging); }
 
-	//  for host <-> host copies, use memcpy
-	if(spec.source_device == device_id::host && spec.target_device == device_id::host) {
-		if(debug) utils::err_print("  -> h2h\n");
-		if(last_device != device_id::host && last_device != device_id::count) {
-			if(debug) utils::err_print("  -> waiting on {}\n", last_device);
-			exec.get_queue(last_device).wait_and_throw();
+std::byte* executor::get_host_buffer(device_id id) { return get_or_allocate_buffer(id, buffer_role::host); }
+std::byte* executor::get_host_staging_buffer(device_id id) { return get_or_allocate_buffer(id, buffer_role::host_staging); }
+
+sycl::event copy_with_kernel(sycl::queue& q, const copy_spec& spec, const kernel_tuning& tuning, const std::vector<sycl::event>& deps);
+sycl::event convert_with_kernel(sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size, const std::vector<sycl::event>& deps);
+// batched kernel copies perform all the given same-device copies with a single kernel launch, using a descriptor table which is written to host_table
+// and then needs to be uploaded to the device table the launch reads; both hold get_batched_copy_table_size(specs.size()) bytes
+batched_kernel_copy write_batched_copy_table(const std::vector<copy_spec>& specs, std::byte* host_table);
+sycl::event launch_batched_copy(
+    sycl::queue& q, const batched_kernel_copy& batch, const std::byte* device_table, int32_t preferred_wg_size, const std::vector<sycl::event>& deps);
+int64_t get_batched_copy_table_size(int64_t copy_count);
+// compressed staging: counts the non-zero blocks of the source into *counter, and if a stream is given also packs them into it (see the kernels)
+sycl::event pack_nonzero_blocks(sycl::queue& q, const std::byte* source, int64_t bytes, uint32_t* counter, std::byte* stream, const std::vector<sycl::event>& deps);
+sycl::event unpack_blocks(sycl::queue& q, const std::byte* stream, int64_t packed_blocks, std::byte* target, int64_t bytes, const std::vector<sycl::event>& deps);
+int64_t get_compressed_stream_size(int64_t bytes, int64_t packed_blocks);
+
+// a plain memcpy on the queue, which only goes through a command group if it has dependencies
+sycl::event enqueue_memcpy(sycl::queue& queue, const std::byte* src, std::byte* tgt, int64_t length, const std::vector<sycl::event>& deps) {
+	if(deps.empty()) { return queue.copy(src, tgt, length); }
+	return queue.submit([&](sycl::handler& cgh) {
+		cgh.depends_on(deps);
+		cgh.memcpy(tgt, src, length);
+	});
+}
+
+// whether kernels can access the memory of the given layout
+bool is_device_accessible(const executor& exec, device_id did, const data_layout& layout) {
+	if(did != device_id::host) { return true; }
+	const auto kind = exec.get_memory_kind(layout.base_ptr() + layout.offset, did);
+	return kind == memory_kind::host_pinned || kind == memory_kind::shared;
+}
+
+// the stream of non-zero blocks is only transferred if it is at most this fraction of the data (in percent), the data itself otherwise
+constexpr int64_t max_compressed_percentage = 75;
+
+// the header of host staging holding compressed data, see compressed_staging_header_size: the device counters the copy to the staging packs with,
+// which are placed along with the staging, and the number of packed blocks it leaves for the copy from the staging
+struct compressed_staging_header {
+	uint32_t* counters = nullptr; // none if the staging was not placed by the executor, which leaves the data uncompressed
+	int64_t packed_blocks = -1;   // not compressed
+};
+static_assert(sizeof(compressed_staging_header) <= compressed_staging_header_size);
+constexpr int64_t compression_counters_size = 2 * sizeof(uint32_t);
+
+// whether the copy compresses into host staging, and thus needs counters placed along with it
+bool is_compressing_copy(const copy_spec& spec) { return spec.properties & copy_properties::use_compression && spec.target_device == device_id::host; }
+
+compressed_staging_header read_compressed_staging_header(const data_layout& staged) {
+	compressed_staging_header header;
+	std::memcpy(&header, staged.base_ptr() + staged.offset - compressed_staging_header_size, sizeof(header));
+	return header;
+}
+
+void write_compressed_staging_header(const data_layout& staged, const compressed_staging_header& header) {
+	std::memcpy(staged.base_ptr() + staged.offset - compressed_staging_header_size, &header, sizeof(header));
+}
+
+// copy from a device into compressed host staging: the non-zero blocks are counted on the device, and if that pays off packed directly into the
+// (pinned) staging by a kernel, so that only they are transferred; the header of the staging tells enqueue_decompressing_copy what it holds
+// this waits for the count, and for the packing to finish before the counters are reused
+sycl::event enqueue_compressing_copy(const executor& exec, sycl::queue& queue, const copy_spec& spec, const std::vector<sycl::event>& deps) {
+	const auto src = spec.source_layout.base_ptr() + spec.source_layout.offset;
+	const auto tgt = spec.target_layout.base_ptr() + spec.target_layout.offset;
+	const auto bytes = spec.source_layout.total_bytes();
+	const auto max_compressed_bytes = bytes * max_compressed_percentage / 100;
+
+	auto header = read_compressed_staging_header(spec.target_layout);
+	header.packed_blocks = -1;
+	std::optional<sycl::event> packed;
+	if(header.counters != nullptr && get_compressed_stream_size(bytes, 0) <= max_compressed_bytes
+	    && is_device_accessible(exec, device_id::host, spec.target_layout)) {
+		queue.memset(header.counters, 0, compression_counters_size);
+		pack_nonzero_blocks(queue, src, bytes, header.counters, nullptr, deps);
+		uint32_t nonzero_blocks = 0;
+		queue.copy(header.counters, &nonzero_blocks, 1).wait_and_throw();
+		if(get_compressed_stream_size(bytes, nonzero_blocks) <= max_compressed_bytes) {
+			packed = pack_nonzero_blocks(queue, src, bytes, header.counters + 1, tgt, {});
+			packed->wait_and_throw();
+			header.packed_blocks = nonzero_blocks;
 		}
-		copy_via_repeated_1D_copies(
-		    [](const std::byte* src, std::byte* tgt, int64_t length) { std::memcpy(tgt, src, length); }, spec.source_layout, spec.target_layout);
-		return {device_id::host, 0};
 	}
+	write_compressed_staging_header(spec.target_layout, header);
+	if(packed.has_value()) { return *packed; }
+	return enqueue_memcpy(queue, src, tgt, bytes, deps);
+}
 
-	const device_id desired_device = alternate_device ? spec.target_device : spec.source_device;
-	const device_id fallback_device = alternate_device ? spec.source_device : spec.target_device;
-	const device_id device_to_use = desired_device == device_id::host ? fallback_device : desired_device;
-	const executor::target target{device_to_use, queue_idx};
+// copy from host staging written by enqueue_compressing_copy to a device: the packed blocks are read directly from the (pinned) staging by a kernel
+sycl::event enqueue_decompressing_copy(sycl::queue& queue, const copy_spec& spec, const std::vector<sycl::event>& deps) {
+	const auto src = spec.source_layout.base_ptr() + spec.source_layout.offset;
+	const auto tgt = spec.target_layout.base_ptr() + spec.target_layout.offset;
+	const auto bytes = spec.source_layout.total_bytes();
+	const auto packed_blocks = read_compressed_staging_header(spec.source_layout).packed_blocks;
+	if(packed_blocks < 0) { return enqueue_memcpy(queue, src, tgt, bytes, deps); }
+	return unpack_blocks(queue, src, packed_blocks, tgt, bytes, deps);
+}
 
-	if(debug) utils::err_print("  -> performing copy on queue for device {}\n", device_to_use);
-	if(last_target != target && last_device != device_id::count && last_device != device_id::host) {
-		// utils::err_print("  -> waiting on {}\n", last_device);
-		exec.get_queue(last_target).wait_and_throw();
+// enqueue the copy operation(s) implementing a device-involving copy spec on the given (in-order) queue, after the given dependencies
+// returns an event for the last operation enqueued
+sycl::event enqueue_copy(executor& exec, sycl::queue& queue, const copy_spec& spec, const std::vector<sycl::event>& deps) {
+	if(spec.properties & copy_properties::use_compression) {
+		COPYLIB_ENSURE(is_valid(spec), "Invalid compressed copy: {}", spec);
+		return spec.target_device == device_id::host ? enqueue_compressing_copy(exec, queue, spec, deps) : enqueue_decompressing_copy(queue, spec, deps);
 	}
 
-	auto& queue = exec.get_queue(target);
+	// element conversions are always performed by a kernel, which manifest_strategy places on a device holding (or next to) both layouts
+	if(spec.conversion != element_conversion::none) {
+		COPYLIB_ENSURE((spec.source_device == spec.target_device || spec.source_device == device_id::host || spec.target_device == device_id::host)
+		                   && is_device_accessible(exec, spec.source_device, spec.source_layout) && is_device_accessible(exec, spec.target_device, spec.target_layout),
+		    "Cannot convert elements with a kernel between these layouts, split off the conversion with apply_element_conversion: {}", spec);
+		return convert_with_kernel(queue, spec, exec.get_preferred_wg_size(), deps);
+	}
 
 	// if the source and target are contiguous, we can use a single copy operation
 	if(spec.is_contiguous()) {
-		queue.copy(spec.source_layout.base_ptr() + spec.source_layout.offset, spec.target_layout.base_ptr() + spec.target_layout.offset,
-		    spec.source_layout.total_bytes());
-		return target;
+		return enqueue_memcpy(queue, spec.source_layout.base_ptr() + spec.source_layout.offset, spec.target_layout.base_ptr() + spec.target_layout.offset,
+		    spec.source_layout.total_bytes(), deps);
 	}
 
-	// technically, one could use a kernel for copies involving the host on some hw/sw stacks, but we'll ignore that for now
-	if(spec.properties & copy_properties::use_kernel && spec.source_device != device_id::host && spec.target_device != device_id::host) {
-		copy_with_kernel(queue, spec, exec.get_preferred_wg_size());
+	// kernels can access host memory directly (zero-copy) if it is pinned or shared, but would page fault or fail on pageable memory
+	// that moves the host side over the interconnect at the access pattern of the kernel, so it is only done if requested
+	const auto kernel_accessible = [&](device_id did, const data_layout& layout) {
+		return did != device_id::host || (spec.properties & copy_properties::use_zero_copy && is_device_accessible(exec, did, layout));
+	};
+	if(spec.properties & copy_properties::use_kernel && kernel_accessible(spec.source_device, spec.source_layout)
+	    && kernel_accessible(spec.target_device, spec.target_layout)) {
+		const auto kernel_device = spec.source_device != device_id::host ? spec.source_device : spec.target_device;
+		return copy_with_kernel(queue, spec, exec.get_kernel_tuning(kernel_device), deps);
 	} else if(spec.properties & copy_properties::use_2D_copy) {
 #if SYCL_EXT_ONEAPI_MEMCPY2D > 0
 		const auto dst_ptr = spec.target_layout.base_ptr() + spec.target_layout.offset;
@@ -355,7 +603,11 @@ executor::target execute_copy(executor& exec, const copy_spec& spec, int64_t que
 		const auto effective_src_stride = spec.source_layout.effective_stride();
 		const auto width = spec.source_layout.fragment_length;
 		const auto count = spec.source_layout.fragment_count;
-		queue.ext_oneapi_memcpy2d(dst_ptr, effective_dst_stride, src_ptr, effective_src_stride, width, count);
+		if(deps.empty()) { return queue.ext_oneapi_memcpy2d(dst_ptr, effective_dst_stride, src_ptr, effective_src_stride, width, count); }
+		return queue.submit([&](sycl::handler& cgh) {
+			cgh.depends_on(deps);
+			cgh.ext_oneapi_memcpy2d(dst_ptr, effective_dst_stride, src_ptr, effective_src_stride, width, count);
+		});
 #elif ACPP_WITH_CUDA
 		const cudaMemcpyKind kind = [&] {
 			if(spec.source_device == device_id::host && spec.target_device != device_id::host) {
@@ -366,148 +618,814 @@ executor::target execute_copy(executor& exec, const copy_spec& spec, int64_t que
 				return cudaMemcpyDeviceToDevice;
 			}
 		}();
-		queue.AdaptiveCpp_enqueue_custom_operation([=](sycl::interop_handle handle) {
-			const auto& stream = handle.get_native_queue<sycl::backend::cuda>();
-			cudaMemcpy2DAsync(spec.target_layout.base_ptr() + spec.target_layout.offset, spec.target_layout.effective_stride(), //
-			    spec.source_layout.base_ptr() + spec.source_layout.offset, spec.source_layout.effective_stride(),               //
-			    spec.source_layout.fragment_length, spec.source_layout.fragment_count, kind, stream);
+		return queue.submit([&](sycl::handler& cgh) {
+			cgh.depends_on(deps);
+			cgh.AdaptiveCpp_enqueue_custom_operation([=](sycl::interop_handle handle) {
+				const auto& stream = handle.get_native_queue<sycl::backend::cuda>();
+				cudaMemcpy2DAsync(spec.target_layout.base_ptr() + spec.target_layout.offset, spec.target_layout.effective_stride(), //
+				    spec.source_layout.base_ptr() + spec.source_layout.offset, spec.source_layout.effective_stride(),               //
+				    spec.source_layout.fragment_length, spec.source_layout.fragment_count, kind, stream);
+			});
 		});
 #else
 		COPYLIB_ERROR("2D copy requested, but not supported by the backend");
 #endif // SYCL_EXT_ONEAPI_MEMCPY2D
-	} else {
-		copy_via_repeated_1D_copies(
-		    [&](const std::byte* src, std::byte* tgt, int64_t length) { queue.copy(src, tgt, length); }, spec.source_layout, spec.target_layout);
 	}
-	return target;
+	// the queue is in-order, so only the first copy needs to carry the dependencies, and the last event covers all of them
+	sycl::event last_event;
+	bool first = true;
+	copy_via_repeated_1D_copies(
+	    [&](const std::byte* src, std::byte* tgt, int64_t length) {
+		    last_event = enqueue_memcpy(queue, src, tgt, length, first ? deps : std::vector<sycl::event>{});
+		    first = false;
+	    },
+	    spec.source_layout, spec.target_layout);
+	return last_event;
+}
+
+// select the device whose queues perform the given (not host to host) copy
+device_id get_device_for_copy(const copy_spec& spec, bool alternate_device) {
+	const device_id desired_device = alternate_device ? spec.target_device : spec.source_device;
+	const device_id fallback_device = alternate_device ? spec.source_device : spec.target_device;
+	return desired_device == device_id::host ? fallback_device : desired_device;
+}
+
+// the queue a copy was performed on, and the event of its last operation (none for host to host copies)
+struct copy_step_result {
+	executor::target target;
+	std::optional<sycl::event> event;
+};
+
+copy_step_result execute_copy_impl(
+    executor& exec, const copy_spec& spec, int64_t queue_idx, bool alternate_device, const executor::target last_target) {
+	constexpr bool debug = false;
+	const device_id last_device = last_target.did;
+	if(debug) utils::err_print("{}:\n  -> last_device is {}\n", spec, last_device);
+
+	//  for host <-> host copies, use memcpy
+	if(spec.source_device == device_id::host && spec.target_device == device_id::host) {
+		if(debug) utils::err_print("  -> h2h\n");
+		if(last_device != device_id::host && last_device != device_id::none) {
+			if(debug) utils::err_print("  -> waiting on {}\n", last_device);
+			exec.get_queue(last_device).wait_and_throw();
+		}
+		exec.get_host_copy_engine().copy(spec);
+		return {{device_id::host, 0}, std::nullopt};
+	}
+
+	const device_id device_to_use = get_device_for_copy(spec, alternate_device);
+	const executor::target target{device_to_use, queue_idx};
+
+	if(debug) utils::err_print("  -> performing copy on queue for device {}\n", device_to_use);
+	if(last_target != target && last_device != device_id::none && last_device != device_id::host) {
+		// utils::err_print("  -> waiting on {}\n", last_device);
+		exec.get_queue(last_target).wait_and_throw();
+	}
+
+	return {target, enqueue_copy(exec, exec.get_queue(target), spec, {})};
 }
 
+executor::target execute_copy(executor& exec, const copy_spec& spec, int64_t queue_idx, bool alternate_device, const executor::target last_target) {
+	return execute_copy_impl(exec, spec, queue_idx, alternate_device, last_target).target;
+}
+
+// places the staging buffers of a set of plans in regions of the executor's staging pool, which are held until release() (or destruction)
 class staging_fulfiller {
   public:
-	staging_fulfiller(executor& exec) : exec(exec) {}
-
-	void fulfill(data_layout& layout) {
-		if(layout.is_unplaced_staging()) {
-			const auto staging_idx = layout.staging.index;
-			auto staging_it = staging_buffers.find(staging_idx);
-			if(staging_it == staging_buffers.end()) {
-				const auto did = layout.staging.did;
-				const bool host = layout.staging.on_host;
-				COPYLIB_ENSURE(did != device_id::host, "Device id for staging cannot be host");
-				staging_info info{
-				    .size = layout.total_extent(),
-				    .device = did,
-				    .on_host = host,
-				};
-				if(host) {
-					info.buffer = exec.get_host_staging_buffer(did) + current_host_staging_offsets[static_cast<size_t>(did)];
-					current_host_staging_offsets[static_cast<size_t>(did)] += info.size + staging_alignment % info.size;
-					COPYLIB_ENSURE(current_host_staging_offsets[static_cast<size_t>(did)] <= exec.get_buffer_size(),
-					    "Staging buffer overflow on host for device {}", static_cast<int>(did));
-				} else {
-					info.buffer = exec.get_staging_buffer(did) + current_staging_offsets[static_cast<size_t>(did)];
-					current_staging_offsets[static_cast<size_t>(did)] += info.size + staging_alignment % info.size;
-					COPYLIB_ENSURE(current_staging_offsets[static_cast<size_t>(did)] <= exec.get_buffer_size(), "Staging buffer overflow for device {}",
-					    static_cast<int>(did));
+	// extra_requests are acquired along with the staging buffers (all or nothing), for other temporary memory needed by the copies
+	// long_lived marks the regions as held indefinitely, see staging_pool::acquire
+	staging_fulfiller(executor& exec, std::span<copy_plan> plans, const std::vector<staging_request>& extra_requests = {}, bool long_lived = false)
+	    : exec(exec) {
+		// staging indices are usually handed out sequentially by the providers, so they are looked up densely relative to the lowest one;
+		// sparse indices (e.g. of sets manifested with a provider shared with other sets) are looked up in a hash map instead
+		std::vector<data_layout*> staging_layouts;
+		std::vector<const copy_spec*> compressing_copies; // into host staging, which need device counters as well
+		uint32_t min_index = std::numeric_limits<uint32_t>::max();
+		uint32_t max_index = 0;
+		for(auto& plan : plans) {
+			for(auto& spec : plan) {
+				if(is_compressing_copy(spec) && spec.target_layout.is_unplaced_staging()) { compressing_copies.push_back(&spec); }
+				for(auto layout : {&spec.source_layout, &spec.target_layout}) {
+					if(!layout->is_unplaced_staging()) { continue; }
+					staging_layouts.push_back(layout);
+					min_index = std::min(min_index, layout->staging.index);
+					max_index = std::max(max_index, layout->staging.index);
 				}
-				staging_it = staging_buffers.emplace(staging_idx, info).first;
+			}
+		}
+		if(staging_layouts.empty() && extra_requests.empty()) { return; }
+		if(staging_layouts.empty()) { min_index = 0; }
+
+		const bool dense = max_index - min_index < 4 * staging_layouts.size() + 1024;
+		std::vector<int64_t> dense_requests(dense ? max_index - min_index + 1 : 0, -1);
+		std::unordered_map<uint32_t, int64_t> sparse_requests;
+		const auto request_of_index = [&](uint32_t index) -> int64_t& {
+			return dense ? dense_requests[index - min_index] : sparse_requests.try_emplace(index, -1).first->second;
+		};
+		std::vector<staging_request> requests;
+		std::vector<int64_t> request_of_layout; // parallel to staging_layouts
+		request_of_layout.reserve(staging_layouts.size());
+		for(const auto layout : staging_layouts) {
+			auto& req_idx = request_of_index(layout->staging.index);
+			if(req_idx < 0) {
+				req_idx = static_cast<int64_t>(requests.size());
+				requests.push_back({.did = layout->staging.did, .on_host = static_cast<bool>(layout->staging.on_host), .size = layout->total_extent()});
 			} else {
-				COPYLIB_ENSURE(staging_buffers[staging_idx].size == layout.total_extent(), "Staging buffer size mismatch");
-				COPYLIB_ENSURE(staging_buffers[staging_idx].device == layout.staging.did, "Staging buffer device mismatch");
-				COPYLIB_ENSURE(staging_buffers[staging_idx].on_host == layout.staging.on_host, "Staging buffer host flag mismatch");
+				const auto& req = requests[req_idx];
+				COPYLIB_ENSURE(req.size == layout->total_extent(), "Staging buffer size mismatch");
+				COPYLIB_ENSURE(req.did == layout->staging.did, "Staging buffer device mismatch");
+				COPYLIB_ENSURE(req.on_host == static_cast<bool>(layout->staging.on_host), "Staging buffer host flag mismatch");
 			}
-			layout.base = reinterpret_cast<intptr_t>(staging_it->second.buffer);
+			request_of_layout.push_back(req_idx);
+		}
+		const auto first_counter_request = requests.size();
+		for(const auto spec : compressing_copies) {
+			requests.push_back({.did = spec->source_device, .on_host = false, .size = compression_counters_size});
+		}
+		const auto first_extra_request = requests.size();
+		requests.insert(requests.end(), extra_requests.begin(), extra_requests.end());
+		regions = exec.get_staging_pool().acquire(requests, long_lived);
+		for(size_t i = 0; i < staging_layouts.size(); i++) {
+			staging_layouts[i]->base = reinterpret_cast<intptr_t>(regions[request_of_layout[i]].ptr);
 		}
+		for(size_t i = 0; i < compressing_copies.size(); i++) {
+			write_compressed_staging_header(compressing_copies[i]->target_layout, {.counters = reinterpret_cast<uint32_t*>(regions[first_counter_request + i].ptr)});
+		}
+		extra_regions.assign(regions.begin() + first_extra_request, regions.end());
 	}
+	~staging_fulfiller() { release(); }
+
+	staging_fulfiller(const staging_fulfiller&) = delete;
+	staging_fulfiller& operator=(const staging_fulfiller&) = delete;
 
-	void fulfill(copy_spec& spec) {
-		fulfill(spec.source_layout);
-		fulfill(spec.target_layout);
+	// return the staging regions to the pool; only call this once the copies using them are complete
+	void release() {
+		exec.get_staging_pool().release(regions);
+		regions.clear();
+		extra_regions.clear();
 	}
 
+	// the regions for the extra requests, in order
+	const std::vector<staging_region>& get_extra_regions() const { return extra_regions; }
+
   private:
 	executor& exec;
-	std::vector<int64_t> current_staging_offsets = std::vector<int64_t>(static_cast<int>(device_id::count), 0);
-	std::vector<int64_t> current_host_staging_offsets = std::vector<int64_t>(static_cast<int>(device_id::count), 0);
-	static constexpr int64_t staging_alignment = 128;
-
-	struct staging_info {
-		int64_t size = 0;
-		device_id device = device_id::d0;
-		bool on_host = false;
-		std::byte* buffer = nullptr;
-	};
-	std::unordered_map<decltype(staging_id::index), staging_info> staging_buffers;
+	std::vector<staging_region> regions;
+	std::vector<staging_region> extra_regions;
 };
 
-class noop_fulfiller {
-  public:
-	void fulfill(copy_spec&) {}
+// execute the steps of a plan whose staging buffers have been placed
+copy_step_result execute_plan_impl(executor& exec, const copy_plan& plan, int64_t queue_idx, bool alternate_device) {
+	copy_step_result last{executor::null_target, std::nullopt};
+	for(const auto& spec : plan) {
+		last = execute_copy_impl(exec, spec, queue_idx, alternate_device, last.target);
+	}
+	return last;
+}
+
+// check all specs of a plan against the registered buffers (only their placed layouts can be checked)
+void validate_plan(const executor& exec, const copy_plan& plan) {
+	for(const auto& spec : plan) {
+		const auto error = check_against_registry(exec.get_registry(), spec);
+		COPYLIB_ENSURE(!error.has_value(), "Invalid copy {}: {}", spec, *error);
+	}
+}
+
+void execute_copy(executor& exec, const copy_plan& plan) {
+	validate_plan(exec, plan);
+	copy_plan fulfilled_plan = plan;
+	staging_fulfiller fulfiller(exec, std::span(&fulfilled_plan, 1));
+	auto last = execute_plan_impl(exec, fulfilled_plan, 0, false);
+	// the staging regions are returned to the pool on return, so the copies using them must be complete
+	if(last.event.has_value()) { last.event->wait_and_throw(); }
+}
+
+namespace {
+	// whether all plans consist of the same sequence of steps between the same devices, as is the case for chunks manifested from a single spec
+	bool has_uniform_steps(const parallel_copy_set& set) {
+		if(set.empty()) { return false; }
+		const auto& reference = set.front();
+		return std::ranges::all_of(set, [&](const copy_plan& plan) {
+			if(plan.size() != reference.size()) { return false; }
+			for(size_t k = 0; k < plan.size(); k++) {
+				if(plan[k].source_device != reference[k].source_device || plan[k].target_device != reference[k].target_device) { return false; }
+			}
+			return true;
+		});
+	}
+
+	// up to this average size, launch overheads dominate the kernel copies of a step, so that they are better performed by a single batched launch
+	constexpr int64_t max_batched_copy_bytes = 64 * 1024;
+
+	// fragmented copies within a device performed by kernels, which the batched kernel can perform as well
+	bool is_batchable_copy(const copy_spec& spec) {
+		return spec.source_device == spec.target_device && spec.source_device != device_id::host && spec.properties & copy_properties::use_kernel
+		       && spec.conversion == element_conversion::none && !spec.is_contiguous();
+	}
+
+	// the steps of a uniform copy set whose kernel copies are small enough to be batched; empty if the set is better executed plan by plan
+	// sets with host to host steps are not batched, since the host engine performs those synchronously
+	std::vector<size_t> get_batched_steps(const parallel_copy_set& set) {
+		if(set.size() < 2 || !has_uniform_steps(set)) { return {}; }
+		const auto& reference = set.front();
+		std::vector<size_t> steps;
+		for(size_t k = 0; k < reference.size(); k++) {
+			if(reference[k].source_device == device_id::host && reference[k].target_device == device_id::host) { return {}; }
+			if(!std::ranges::all_of(set, [k](const copy_plan& plan) { return is_batchable_copy(plan[k]); })) { continue; }
+			int64_t total_bytes = 0;
+			for(const auto& plan : set) {
+				total_bytes += plan[k].source_layout.total_bytes();
+			}
+			if(total_bytes <= max_batched_copy_bytes * static_cast<int64_t>(set.size())) { steps.push_back(k); }
+		}
+		return steps;
+	}
+} // namespace
+
+struct compiled_copy_set::state {
+	std::vector<copy_plan> fulfilled_plans;
+	std::unique_ptr<staging_fulfiller> staging;
+	plan_partition partition;          // of the plans across the workers, unless batched
+	std::vector<size_t> batched_steps; // if not empty, the set is executed step by step, see copy_handle::state::execute_batched
+	// for each batched step, its batch and device descriptor table, uploaded (from pinned host staging) by the event
+	std::vector<batched_kernel_copy> batches;
+	std::vector<const std::byte*> batch_tables;
+	std::vector<sycl::event> batch_table_uploads;
 };
 
-template <typename T>
-concept StagingFulfiller = requires(T f, copy_spec c) {
-	{ f.fulfill(c) };
+struct copy_handle::state {
+	executor* exec = nullptr;
+	std::shared_ptr<const compiled_copy_set::state> compiled;
+	bool release_staging = false; // whether the staging of the compiled set is returned to the pool on completion, as it is not executed again
+	std::atomic<int64_t> plans_remaining = 0;
+	// the last event on each device queue used by each worker (queues are in-order, so this covers all the work on them)
+	// each worker only writes its own entry, and they are only read once all plans are done
+	std::vector<std::unordered_map<device_id, sycl::event>> worker_events;
+
+	mutable std::mutex mutex;
+	std::condition_variable completed_cv;
+	bool submitted = false;
+	bool complete = false;
+	std::vector<std::function<void()>> continuations;
+	std::unordered_map<device_id, std::vector<sycl::event>> device_events; // not modified once submitted, so that they can be waited on without the lock
+	std::unordered_map<device_id, sycl::event> joined_events;              // per device which several queues were used on, see get_event
+
+	void execute_plan(int64_t plan_idx, int64_t worker_idx) {
+		const auto& plan = compiled->fulfilled_plans[plan_idx];
+		const bool use_alternate_device = plan.size() == 1 && plan_idx % 2 == 1;
+		const auto last = execute_plan_impl(*exec, plan, worker_idx, use_alternate_device);
+		if(last.event.has_value()) { worker_events[worker_idx].insert_or_assign(last.target.did, *last.event); }
+		if(--plans_remaining == 0) { all_plans_submitted(); }
+	}
+
+	// execute all plans step by step on one queue per device, performing each of the batched steps for all plans with a single kernel launch
+	void execute_batched(int64_t worker_idx) {
+		const auto& plans = compiled->fulfilled_plans;
+		const auto& reference = plans.front();
+		auto& events = worker_events[worker_idx];
+		size_t next_batch = 0;
+		for(size_t k = 0; k < reference.size(); k++) {
+			const auto did = get_device_for_copy(reference[k], false);
+			auto& queue = exec->get_queue(did, worker_idx);
+			// the queues are in-order, so the last event on each of the other devices covers all previous steps performed there
+			std::vector<sycl::event> deps;
+			for(const auto& [other_did, evt] : events) {
+				if(other_did != did) { deps.push_back(evt); }
+			}
+			if(std::ranges::find(compiled->batched_steps, k) != compiled->batched_steps.end()) {
+				deps.push_back(compiled->batch_table_uploads[next_batch]);
+				const auto& batch = compiled->batches[next_batch];
+				events.insert_or_assign(did, launch_batched_copy(queue, batch, compiled->batch_tables[next_batch], exec->get_preferred_wg_size(), deps));
+				next_batch++;
+			} else {
+				for(const auto& plan : plans) {
+					events.insert_or_assign(did, enqueue_copy(*exec, queue, plan[k], deps));
+					deps.clear();
+				}
+			}
+		}
+		if(--plans_remaining == 0) { all_plans_submitted(); }
+	}
+
+	// called by the worker which finished the last plan; it waits for the device work and completes the copy set
+	void all_plans_submitted() {
+		{
+			std::lock_guard lock(mutex);
+			for(const auto& events : worker_events) {
+				for(const auto& [did, evt] : events) {
+					device_events[did].push_back(evt);
+				}
+			}
+			submitted = true;
+		}
+		completed_cv.notify_all(); // all events are known now
+		for(auto& [_, events] : device_events) {
+			sycl::event::wait_and_throw(events);
+		}
+		if(release_staging) { compiled->staging->release(); }
+		// run continuations before signaling completion, so that waiting on the handle also covers them
+		while(true) {
+			std::vector<std::function<void()>> to_run;
+			{
+				std::lock_guard lock(mutex);
+				if(continuations.empty()) {
+					complete = true;
+					break;
+				}
+				to_run.swap(continuations);
+			}
+			for(auto& continuation : to_run) {
+				continuation();
+			}
+		}
+		completed_cv.notify_all();
+	}
 };
 
-void execute_plan_impl(executor& exec, const copy_plan& plan, StagingFulfiller auto& fulfiller, int64_t queue_idx, bool alternate_device) {
-	executor::target last_target = executor::null_target;
-	for(auto spec : plan) {
-		fulfiller.fulfill(spec);
-		last_target = execute_copy(exec, spec, queue_idx, alternate_device, last_target);
+void copy_handle::wait() const {
+	if(!copy_state) { return; }
+	std::unique_lock lock(copy_state->mutex);
+	copy_state->completed_cv.wait(lock, [&] { return copy_state->complete; });
+}
+
+bool copy_handle::test() const {
+	if(!copy_state) { return true; }
+	std::lock_guard lock(copy_state->mutex);
+	return copy_state->complete;
+}
+
+void copy_handle::then(std::function<void()> continuation) const {
+	if(copy_state) {
+		std::unique_lock lock(copy_state->mutex);
+		if(!copy_state->complete) {
+			copy_state->continuations.push_back(std::move(continuation));
+			return;
+		}
+	}
+	continuation();
+}
+
+double copy_handle::get_imbalance() const { return copy_state ? compiled_copy_set(copy_state->compiled).get_imbalance() : 1.0; }
+
+std::optional<sycl::event> copy_handle::get_event(device_id did) const {
+	if(!copy_state || did == device_id::host) { return std::nullopt; }
+	std::unique_lock lock(copy_state->mutex);
+	// events are only known once all plans are submitted
+	copy_state->completed_cv.wait(lock, [&] { return copy_state->submitted; });
+	auto it = copy_state->device_events.find(did);
+	if(it == copy_state->device_events.end() || it->second.empty()) { return std::nullopt; }
+	const auto& events = it->second;
+	if(events.size() == 1) { return events.front(); }
+	// several queues of this device were used, join them into a single event (once)
+	if(const auto joined = copy_state->joined_events.find(did); joined != copy_state->joined_events.end()) { return joined->second; }
+	auto& queue = copy_state->exec->get_queue(did);
+#if SYCL_EXT_ONEAPI_ENQUEUE_BARRIER > 0
+	const auto joined = queue.ext_oneapi_submit_barrier(events);
+#else
+	const auto joined = queue.submit([&](sycl::handler& cgh) {
+		cgh.depends_on(events);
+		cgh.single_task([] {});
+	});
+#endif
+	copy_state->joined_events.emplace(did, joined);
+	return joined;
+}
+
+double compiled_copy_set::get_imbalance() const {
+	if(!compiled_state || compiled_state->partition.parts.empty()) { return 1.0; }
+	return compiled_state->partition.imbalance();
+}
+
+namespace {
+	// the staging of sets which are compiled to be executed repeatedly is long-lived, that of sets executed once is released on completion
+	std::shared_ptr<const compiled_copy_set::state> compile_impl(executor& exec, const parallel_copy_set& set, bool long_lived) {
+		if(set.empty()) { return {}; }
+		for(const auto& plan : set) {
+			validate_plan(exec, plan);
+		}
+		auto state = std::make_shared<compiled_copy_set::state>();
+		state->fulfilled_plans = set;
+		state->batched_steps = get_batched_steps(set);
+		// the descriptor tables of the batched steps are extra staging regions, a pinned and a device one per step
+		std::vector<staging_request> table_requests;
+		for(const auto k : state->batched_steps) {
+			const auto did = set.front()[k].source_device;
+			const auto table_size = get_batched_copy_table_size(set.size());
+			table_requests.push_back({.did = did, .on_host = true, .size = table_size});
+			table_requests.push_back({.did = did, .on_host = false, .size = table_size});
+		}
+		state->staging = std::make_unique<staging_fulfiller>(exec, std::span(state->fulfilled_plans), table_requests, long_lived);
+
+		if(state->batched_steps.empty()) {
+			// initially, balance the plans across workers by estimated cost; idle workers steal from the others
+			state->partition = partition_by_cost(set, exec.get_scheduler().get_worker_count());
+		} else {
+			const auto& tables = state->staging->get_extra_regions();
+			for(size_t b = 0; b < state->batched_steps.size(); b++) {
+				const auto k = state->batched_steps[b];
+				std::vector<copy_spec> specs;
+				specs.reserve(state->fulfilled_plans.size());
+				for(const auto& plan : state->fulfilled_plans) {
+					specs.push_back(plan[k]);
+				}
+				const auto host_table = tables[2 * b].ptr;
+				const auto device_table = tables[2 * b + 1].ptr;
+				const auto& batch = state->batches.emplace_back(write_batched_copy_table(specs, host_table));
+				state->batch_tables.push_back(device_table);
+				auto& queue = exec.get_queue(set.front()[k].source_device);
+				state->batch_table_uploads.push_back(queue.copy(host_table, device_table, get_batched_copy_table_size(batch.copy_count)));
+			}
+		}
+		return state;
 	}
+} // namespace
+
+compiled_copy_set compile(executor& exec, const parallel_copy_set& set) { return compiled_copy_set(compile_impl(exec, set, true)); }
+
+namespace {
+	copy_handle execute_compiled_async(executor& exec, std::shared_ptr<const compiled_copy_set::state> compiled, bool release_staging) {
+		if(!compiled) { return {}; }
+		auto& scheduler = exec.get_scheduler();
+		const int64_t parts_count = scheduler.get_worker_count();
+
+		auto state = std::make_shared<copy_handle::state>();
+		state->exec = &exec;
+		state->compiled = std::move(compiled);
+		state->release_staging = release_staging;
+		state->worker_events.resize(parts_count);
+		std::vector<std::vector<work_stealing_scheduler::task>> tasks(parts_count);
+		if(!state->compiled->batched_steps.empty()) {
+			// a single worker submits the whole set, which mostly amounts to a few kernel launches
+			state->plans_remaining = 1;
+			tasks.front().push_back([state](int64_t worker_idx) { state->execute_batched(worker_idx); });
+		} else {
+			const auto& parts = state->compiled->partition.parts;
+			COPYLIB_ENSURE(static_cast<int64_t>(parts.size()) == parts_count, "Copy set was compiled for {} workers, but the executor has {}", parts.size(),
+			    parts_count);
+			state->plans_remaining = state->compiled->fulfilled_plans.size();
+			for(int64_t part = 0; part < parts_count; part++) {
+				for(const auto plan_idx : parts[part]) {
+					tasks[part].push_back([state, plan_idx](int64_t worker_idx) { state->execute_plan(plan_idx, worker_idx); });
+				}
+			}
+		}
+		scheduler.submit(std::move(tasks));
+		return copy_handle(state);
+	}
+} // namespace
+
+copy_handle execute_copy_async(executor& exec, const parallel_copy_set& set) {
+	// the set is only executed once, so its staging can be returned as soon as it is complete
+	return execute_compiled_async(exec, compile_impl(exec, set, false), true);
 }
 
-void execute_copy(executor& exec, const copy_plan& plan) {
-	staging_fulfiller fulfiller(exec);
-	execute_plan_impl(exec, plan, fulfiller, 0, false);
-}
-
-void execute_copy(executor& exec, const parallel_copy_set& set) {
-	// TODO: smarter staging reuse
-	// TODO make this better and more testable:
-	//      - have a seperate type for executable copy sets, which are already staged and split into appropriate parts
-	//      - test the splitting and staging logic separately
-	const int64_t parts_count = exec.get_queues_per_device();
-	static BS::thread_pool pool(parts_count);
-
-	const int64_t total_plans = set.size();
-
-	staging_fulfiller fulfiller(exec);
-	std::vector<parallel_copy_set> fulfilled_sets(parts_count);
-	std::vector<std::future<void>> futures;
-	int64_t current_set_idx = 0;
-	int64_t sets_added_to_current = 0;
-	std::atomic<int64_t> plans_executed = 0;
-	for(auto& plan : set) {
-		copy_plan fulfilled_plan = plan;
-		for(auto& spec : fulfilled_plan) {
-			fulfiller.fulfill(spec);
-		}
-		fulfilled_sets[current_set_idx].push_back(fulfilled_plan);
-		sets_added_to_current++;
-
-		const int64_t sets_to_add_to_current = total_plans / parts_count //
-		                                       + ((current_set_idx < total_plans % parts_count) ? 1 : 0);
-		if(sets_added_to_current >= sets_to_add_to_current) {
-			futures.push_back(pool.submit_task([&, current_set_idx]() {
-				noop_fulfiller ful;
-				int64_t plan_idx = 0;
-				for(auto& plan : fulfilled_sets[current_set_idx]) {
-					bool use_alternate_device = plan.size() == 1 && plan_idx % 2 == 1;
-					execute_plan_impl(exec, plan, ful, current_set_idx, use_alternate_device);
-					plan_idx++;
-					plans_executed++;
+copy_handle execute_copy_async(executor& exec, const compiled_copy_set& set) { return execute_compiled_async(exec, set.compiled_state, false); }
+
+void execute_copy(executor& exec, const compiled_copy_set& set) { execute_copy_async(exec, set).wait(); }
+
+void execute_copy(executor& exec, const parallel_copy_set& set) { execute_copy_async(exec, set).wait(); }
+
+struct copy_graph::state {
+	// a recorded copy: its queue (the null target for host to host copies), and the base pointers it can be rebased on
+	struct op {
+		copy_spec spec;
+		executor::target target;
+		int64_t previous = -1;    // the op performing the previous step of the same plan, if any
+		int32_t source_base = -1; // index into base_pointers of the base of each layout, -1 for staging
+		int32_t target_base = -1;
+	};
+
+	executor* exec = nullptr;
+	std::unique_ptr<staging_fulfiller> staging;
+	std::vector<op> ops;           // in submission order: step by step, across all plans
+	std::vector<size_t> final_ops; // the op performing the last step of each plan
+	std::vector<intptr_t> base_pointers;
+
+	// replays share the staging, and the scratch space below, so they are performed one at a time
+	std::mutex replay_mutex;
+	// scratch space of replays, which is reused to keep them free of allocations
+	std::vector<std::optional<sycl::event>> events; // per op
+	std::vector<sycl::event> deps;
+	std::vector<sycl::event> final_events;
+
+#if SYCL_EXT_ONEAPI_GRAPH
+	using executable_graph = sycl::ext::oneapi::experimental::command_graph<sycl::ext::oneapi::experimental::graph_state::executable>;
+	std::vector<std::pair<device_id, executable_graph>> command_graphs;
+#endif
+
+	void submit(size_t op_idx, const copy_spec& spec) {
+		const auto& o = ops[op_idx];
+		auto previous_event = o.previous >= 0 ? events[o.previous] : std::nullopt;
+		if(o.target == executor::null_target) {
+			if(previous_event.has_value()) { previous_event->wait_and_throw(); }
+			exec->get_host_copy_engine().copy(spec);
+			events[op_idx].reset();
+			return;
+		}
+		// the queues are in-order, so only steps continuing on another queue need a dependency
+		deps.clear();
+		if(previous_event.has_value() && ops[o.previous].target != o.target) { deps.push_back(*previous_event); }
+		events[op_idx] = enqueue_copy(*exec, exec->get_queue(o.target), spec, deps);
+	}
+
+	void wait() {
+		final_events.clear();
+		for(const auto op_idx : final_ops) {
+			if(events[op_idx].has_value()) { final_events.push_back(*events[op_idx]); }
+		}
+		sycl::event::wait_and_throw(final_events);
+	}
+
+#if SYCL_EXT_ONEAPI_GRAPH
+	// record a command graph for each device involved; this requires each plan to be performed by a single device, without waiting on the host
+	void record_command_graphs() {
+		namespace sycl_exp = sycl::ext::oneapi::experimental;
+		std::vector<device_id> devices_used;
+		for(const auto& o : ops) {
+			if(o.target == executor::null_target || o.spec.properties & copy_properties::use_compression) { return; }
+			if(o.previous >= 0 && ops[o.previous].target.did != o.target.did) { return; }
+			if(std::ranges::find(devices_used, o.target.did) == devices_used.end()) { devices_used.push_back(o.target.did); }
+		}
+		for(const auto did : devices_used) {
+			std::vector<sycl::queue> queues;
+			for(int64_t q = 0; q < exec->get_queues_per_device(); q++) {
+				queues.push_back(exec->get_queue(did, q));
+			}
+			sycl_exp::command_graph<> graph(queues.front().get_context(), queues.front().get_device());
+			graph.begin_recording(queues);
+			for(size_t i = 0; i < ops.size(); i++) {
+				if(ops[i].target.did == did) { submit(i, ops[i].spec); }
+			}
+			graph.end_recording();
+			command_graphs.emplace_back(did, graph.finalize());
+		}
+		std::ranges::fill(events, std::nullopt);
+	}
+#endif
+};
+
+const std::vector<intptr_t>& copy_graph::get_base_pointers() const {
+	static const std::vector<intptr_t> none;
+	return graph_state ? graph_state->base_pointers : none;
+}
+
+bool copy_graph::uses_command_graph() const {
+#if SYCL_EXT_ONEAPI_GRAPH
+	return graph_state && !graph_state->command_graphs.empty();
+#else
+	return false;
+#endif
+}
+
+copy_graph record(executor& exec, const parallel_copy_set& set) {
+	if(set.empty()) { return {}; }
+	for(const auto& plan : set) {
+		validate_plan(exec, plan);
+	}
+	auto state = std::make_shared<copy_graph::state>();
+	state->exec = &exec;
+	std::vector<copy_plan> fulfilled_plans = set;
+	state->staging = std::make_unique<staging_fulfiller>(exec, std::span(fulfilled_plans), std::vector<staging_request>{}, true);
+
+	const auto get_base_index = [&](const data_layout& layout) {
+		if(layout.is_unplaced_staging()) { return int32_t{-1}; }
+		const auto it = std::ranges::find(state->base_pointers, layout.base);
+		if(it != state->base_pointers.end()) { return static_cast<int32_t>(it - state->base_pointers.begin()); }
+		state->base_pointers.push_back(layout.base);
+		return static_cast<int32_t>(state->base_pointers.size() - 1);
+	};
+
+	// as in execute_copy_async, plans are distributed across the queues of each device by estimated cost, and single-step plans alternate devices
+	const auto partition = partition_by_cost(set, exec.get_queues_per_device());
+	std::vector<int64_t> queue_of_plan(set.size());
+	for(size_t part = 0; part < partition.parts.size(); part++) {
+		for(const auto plan_idx : partition.parts[part]) {
+			queue_of_plan[plan_idx] = static_cast<int64_t>(part);
+		}
+	}
+	// submitting step by step gives all queues work early on
+	size_t max_steps = 0;
+	for(const auto& plan : set) {
+		max_steps = std::max(max_steps, plan.size());
+	}
+	std::vector<int64_t> last_op_of_plan(set.size(), -1);
+	for(size_t k = 0; k < max_steps; k++) {
+		for(size_t i = 0; i < set.size(); i++) {
+			if(k >= set[i].size()) { continue; }
+			const auto& spec = fulfilled_plans[i][k];
+			const bool host_to_host = spec.source_device == device_id::host && spec.target_device == device_id::host;
+			const bool use_alternate_device = set[i].size() == 1 && i % 2 == 1;
+			const auto target = host_to_host ? executor::null_target : executor::target{get_device_for_copy(spec, use_alternate_device), queue_of_plan[i]};
+			state->ops.push_back({spec, target, last_op_of_plan[i], get_base_index(set[i][k].source_layout), get_base_index(set[i][k].target_layout)});
+			last_op_of_plan[i] = static_cast<int64_t>(state->ops.size() - 1);
+		}
+	}
+	state->final_ops.assign(last_op_of_plan.begin(), last_op_of_plan.end());
+	state->events.resize(state->ops.size());
+#if SYCL_EXT_ONEAPI_GRAPH
+	state->record_command_graphs();
+#endif
+	return copy_graph(state);
+}
+
+void replay(const copy_graph& graph, const std::vector<intptr_t>& new_base_pointers) {
+	const auto state = graph.graph_state.get();
+	if(state == nullptr) { return; }
+	std::lock_guard lock(state->replay_mutex);
+	if(new_base_pointers.empty()) {
+#if SYCL_EXT_ONEAPI_GRAPH
+		if(!state->command_graphs.empty()) {
+			state->final_events.clear();
+			for(auto& [did, command_graph] : state->command_graphs) {
+				state->final_events.push_back(state->exec->get_queue(did).ext_oneapi_graph(command_graph));
+			}
+			sycl::event::wait_and_throw(state->final_events);
+			return;
+		}
+#endif
+		for(size_t i = 0; i < state->ops.size(); i++) {
+			state->submit(i, state->ops[i].spec);
+		}
+	} else {
+		COPYLIB_ENSURE(new_base_pointers.size() == state->base_pointers.size(), "Replaying a copy graph with {} base pointers requires {} of them",
+		    new_base_pointers.size(), state->base_pointers.size());
+		for(size_t i = 0; i < state->ops.size(); i++) {
+			const auto& o = state->ops[i];
+			copy_spec spec = o.spec;
+			if(o.source_base >= 0) { spec.source_layout.base = new_base_pointers[o.source_base]; }
+			if(o.target_base >= 0) { spec.target_layout.base = new_base_pointers[o.target_base]; }
+			const auto error = check_against_registry(state->exec->get_registry(), spec);
+			COPYLIB_ENSURE(!error.has_value(), "Invalid copy {} in replay: {}", spec, *error);
+			state->submit(i, spec);
+		}
+	}
+	state->wait();
+}
+
+namespace {
+	// a pipeline can be formed if all plans consist of the same sequence of (multiple) steps, as is the case for chunks manifested from a single spec
+	bool is_pipelineable(const parallel_copy_set& set) {
+		if(set.size() < 2 || set.front().size() < 2 || !has_uniform_steps(set)) { return false; }
+		const auto& reference = set.front();
+		const auto same_kind = [](const data_layout& a, const data_layout& b) {
+			if(a.is_unplaced_staging() != b.is_unplaced_staging()) { return false; }
+			return !a.is_unplaced_staging() || (a.staging.did == b.staging.did && a.staging.on_host == b.staging.on_host);
+		};
+		return std::ranges::all_of(set, [&](const copy_plan& plan) {
+			for(size_t k = 0; k < plan.size(); k++) {
+				if(!same_kind(plan[k].source_layout, reference[k].source_layout) || !same_kind(plan[k].target_layout, reference[k].target_layout)) {
+					return false;
 				}
-			}));
-			current_set_idx++;
-			sets_added_to_current = 0;
+			}
+			// staging buffers must only connect consecutive steps for slot reuse to be correct
+			return !plan.front().source_layout.is_unplaced_staging() && !plan.back().target_layout.is_unplaced_staging();
+		});
+	}
+
+	// completion of one step of one chunk in the pipeline: either a device event, or a host task
+	struct step_completion {
+		std::optional<sycl::event> event;
+		std::shared_future<void> host_task;
+
+		void wait() {
+			if(event.has_value()) { event->wait_and_throw(); }
+			if(host_task.valid()) { host_task.wait(); }
+		}
+	};
+} // namespace
+
+parallel_copy_set bounce_pageable_host_memory(const executor& exec, const parallel_copy_set& set) {
+	// continue numbering after the staging buffers already in use by the set
+	uint32_t next_staging_idx = 0;
+	for(const auto& plan : set) {
+		for(const auto& spec : plan) {
+			for(const auto& layout : {spec.source_layout, spec.target_layout}) {
+				if(layout.is_unplaced_staging()) { next_staging_idx = std::max(next_staging_idx, layout.staging.index + 1); }
+			}
+		}
+	}
+	const auto is_pageable = [&exec](const data_layout& layout) {
+		return exec.get_memory_kind(layout.base_ptr() + layout.offset, device_id::host) == memory_kind::host_pageable;
+	};
+	const auto staging_provider = [&next_staging_idx](device_id did, bool on_host, int64_t) { return staging_id{on_host, did, next_staging_idx++}; };
+	return apply_host_bouncing(set, is_pageable, staging_provider);
+}
+
+void execute_copy_pipelined(executor& exec, const parallel_copy_set& unbounced_set, int64_t staging_slots) {
+	COPYLIB_ENSURE(staging_slots > 0, "Need at least one staging slot for pipelining, got {}", staging_slots);
+	for(const auto& plan : unbounced_set) {
+		validate_plan(exec, plan);
+	}
+	const auto set = bounce_pageable_host_memory(exec, unbounced_set);
+	if(!is_pipelineable(set)) {
+		execute_copy(exec, set);
+		return;
+	}
+	const auto& reference = set.front();
+	const size_t num_steps = reference.size();
+	const size_t num_chunks = set.size();
+	const auto slots = static_cast<size_t>(staging_slots);
+
+	// place the staging slots: step k writes slot (k, i % slots), which is then read by step k+1
+	// each slot is sized for the largest chunk (the tail chunk is commonly smaller)
+	std::vector<staging_request> slot_requests;
+	std::vector<size_t> first_slot_of_step(num_steps, 0);
+	for(size_t k = 0; k + 1 < num_steps; k++) {
+		first_slot_of_step[k] = slot_requests.size();
+		const auto& ref_layout = reference[k].target_layout;
+		if(!ref_layout.is_unplaced_staging()) { continue; }
+		int64_t max_extent = 0;
+		for(const auto& plan : set) {
+			max_extent = std::max(max_extent, plan[k].target_layout.total_extent());
 		}
+		slot_requests.insert(slot_requests.end(), slots, {.did = ref_layout.staging.did, .on_host = static_cast<bool>(ref_layout.staging.on_host), .size = max_extent});
 	}
-	for(auto& f : futures) {
-		f.wait();
+	// steps compressing into host staging get device counters for each of their slots as well
+	const auto first_counter_request = slot_requests.size();
+	std::vector<size_t> compressing_steps;
+	for(size_t k = 0; k + 1 < num_steps; k++) {
+		if(!is_compressing_copy(reference[k]) || !reference[k].target_layout.is_unplaced_staging()) { continue; }
+		compressing_steps.push_back(k);
+		slot_requests.insert(slot_requests.end(), slots, {.did = reference[k].source_device, .on_host = false, .size = compression_counters_size});
 	}
-	COPYLIB_ENSURE(plans_executed == total_plans, "Not all plans executed ({} of {})", plans_executed.load(), total_plans);
+	auto& pool = exec.get_staging_pool();
+	const auto slot_regions = pool.acquire(slot_requests);
+	const auto slot_buffer = [&](size_t k, size_t slot) { return slot_regions[first_slot_of_step[k] + slot].ptr; };
+	for(size_t c = 0; c < compressing_steps.size(); c++) {
+		const auto k = compressing_steps[c];
+		for(size_t slot = 0; slot < slots; slot++) {
+			const auto counters = reinterpret_cast<uint32_t*>(slot_regions[first_counter_request + c * slots + slot].ptr);
+			write_compressed_staging_header(data_layout{reinterpret_cast<intptr_t>(slot_buffer(k, slot)), reference[k].target_layout}, {.counters = counters});
+		}
+	}
+
+	// the queue of each step: consecutive steps on the same device use different queues where possible, so that they can overlap
+	std::vector<executor::target> step_targets(num_steps, executor::null_target);
+	std::unordered_map<device_id, int64_t> steps_per_device;
+	for(size_t k = 0; k < num_steps; k++) {
+		const auto& spec = reference[k];
+		if(spec.source_device == device_id::host && spec.target_device == device_id::host) { continue; }
+		const auto did = get_device_for_copy(spec, false);
+		step_targets[k] = {did, steps_per_device[did]++ % exec.get_queues_per_device()};
+	}
+	// host to host steps are performed by one in-order host engine per step
+	std::vector<std::unique_ptr<BS::thread_pool<>>> host_engines(num_steps);
+	for(size_t k = 0; k < num_steps; k++) {
+		if(step_targets[k] == executor::null_target) { host_engines[k] = std::make_unique<BS::thread_pool<>>(1); }
+	}
+
+	std::vector<std::vector<step_completion>> completions(num_chunks, std::vector<step_completion>(num_steps));
+	const auto submit_step = [&](size_t i, size_t k) {
+		copy_spec spec = set[i][k];
+		if(spec.source_layout.is_unplaced_staging()) { spec.source_layout.base = reinterpret_cast<intptr_t>(slot_buffer(k - 1, i % slots)); }
+		if(spec.target_layout.is_unplaced_staging()) { spec.target_layout.base = reinterpret_cast<intptr_t>(slot_buffer(k, i % slots)); }
+
+		// read after write on the data of this chunk, and write after read on the staging slot shared with chunk i - slots
+		std::vector<step_completion*> deps;
+		if(k > 0) { deps.push_back(&completions[i][k - 1]); }
+		if(i >= slots && k + 1 < num_steps) { deps.push_back(&completions[i - slots][k + 1]); }
+
+		auto& completion = completions[i][k];
+		if(host_engines[k]) {
+			completion.host_task = host_engines[k]->submit_task([&exec, deps, spec] {
+				for(auto dep : deps) {
+					dep->wait();
+				}
+				exec.get_host_copy_engine().copy(spec);
+			});
+		} else {
+			auto& queue = exec.get_queue(step_targets[k]);
+			std::vector<sycl::event> dep_events;
+			std::vector<std::shared_future<void>> host_deps;
+			for(auto dep : deps) {
+				if(dep->host_task.valid()) { host_deps.push_back(dep->host_task); }
+				if(dep->event.has_value()) { dep_events.push_back(*dep->event); }
+			}
+			// host steps are bridged into the queue by a host task, so that submitting the later steps does not wait for them
+			if(!host_deps.empty()) {
+				dep_events.push_back(queue.submit([&](sycl::handler& cgh) {
+					cgh.host_task([host_deps] {
+						for(const auto& host_dep : host_deps) {
+							host_dep.wait();
+						}
+					});
+				}));
+			}
+			completion.event = enqueue_copy(exec, queue, spec, dep_events);
+		}
+	};
+
+	// submit in wavefronts: at time t, step k works on chunk t - k; later steps go first, so that their slot is released before it is refilled
+	for(size_t t = 0; t < num_chunks + num_steps - 1; t++) {
+		for(size_t k = num_steps; k-- > 0;) {
+			if(t < k || t - k >= num_chunks) { continue; }
+			submit_step(t - k, k);
+		}
+	}
+	for(auto& chunk_completions : completions) {
+		chunk_completions.back().wait();
+	}
+	pool.release(slot_regions);
 }
 
-} // namespace copylib
\ No newline at end of file
+} // namespace copylib
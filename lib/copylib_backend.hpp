@@ -1,9 +1,65 @@
 #pragma once
 
 #include "copylib_core.hpp"
+#include "copylib_host.hpp"
+#include "copylib_registry.hpp"
+#include "copylib_scheduler.hpp"
+#include "copylib_staging.hpp"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
 
 namespace copylib {
 
+// how a copy kernel is launched: each work item of the (padded) range handles items_per_thread elements
+struct kernel_config {
+	int32_t wg_size = 32;
+	int32_t items_per_thread = 1;
+
+	bool operator==(const kernel_config& other) const = default;
+};
+
+// classes of fragment lengths (in elements) which kernel copies are tuned for separately
+enum class fragment_class : uint8_t {
+	single_element,
+	short_fragments,
+	long_fragments,
+	count,
+};
+
+fragment_class get_fragment_class(int64_t fragment_elements);
+// the fragment length (in elements) copies are measured with when tuning for a fragment class
+int64_t get_representative_fragment_elements(fragment_class fragments);
+
+// the kernel configurations of a device, per element size and fragment class; the default is used for anything not tuned
+class kernel_tuning {
+  public:
+	// the element sizes used by kernel copies
+	static constexpr std::array<int64_t, 7> element_sizes = {1, 2, 4, 8, 16, 32, 64};
+
+	kernel_tuning() = default;
+	explicit kernel_tuning(const kernel_config& default_config) : default_config(default_config) {}
+
+	const kernel_config& get_default() const { return default_config; }
+	const kernel_config& get(int64_t element_size, fragment_class fragments) const;
+	void set(int64_t element_size, fragment_class fragments, const kernel_config& config);
+
+  private:
+	kernel_config default_config;
+	std::array<std::array<std::optional<kernel_config>, static_cast<size_t>(fragment_class::count)>, element_sizes.size()> tuned;
+
+	static size_t get_element_size_index(int64_t element_size);
+};
+
+// the copies of a batch performed by a single kernel launch, as described by a descriptor table in device memory
+struct batched_kernel_copy {
+	int64_t element_size = 0; // the widest element size all copies of the batch allow
+	int64_t copy_count = 0;
+	int64_t total_elems = 0;
+};
+
 struct device {
 	sycl::device dev;
 	std::vector<sycl::queue> queues;
@@ -12,6 +68,20 @@ struct device {
 	std::byte* host_buffer = nullptr;
 	std::byte* host_staging_buffer = nullptr;
 
+	// where the device is attached, which determines the NUMA node its host buffers are placed on
+	pci_device_locality locality;
+	int host_alloc_cpu = 0;
+	int host_numa_node = -1;
+	// whether binding each host buffer to host_numa_node succeeded, and the fraction of its pages verified to reside there
+	struct host_placement {
+		bool bound = false;
+		double fraction_local = 0;
+	};
+	host_placement host_buffer_placement;
+	host_placement host_staging_buffer_placement;
+
+	kernel_tuning tuning;
+
 	device(sycl::device dev, const std::vector<sycl::queue>& queues) : dev(dev), queues(queues) {}
 
 	~device();
@@ -28,10 +98,11 @@ class executor {
 		bool operator==(const target& other) const = default;
 		bool operator!=(const target& other) const = default;
 	};
-	static constexpr target null_target = target{device_id::count, 0};
+	static constexpr target null_target = target{device_id::none, 0};
 
 	executor(int64_t buffer_size);
-	executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_per_device = 1);
+	// buffers are allocated on first use; host buffers are then initialized as selected by host_buffer_init
+	executor(int64_t buffer_size, int64_t devices_needed, int64_t queues_per_device = 1, buffer_init host_buffer_init = buffer_init::pattern);
 
 	sycl::queue& get_queue(device_id id, int64_t queue_idx = 0);
 	sycl::queue& get_queue(const target& tgt) { return get_queue(tgt.did, tgt.queue_idx); }
@@ -51,6 +122,14 @@ class executor {
 	int32_t get_preferred_wg_size() const;
 	std::string get_info() const;
 
+	// how kernel copies are launched on the given device; without autotuning, all use the preferred work-group size
+	const kernel_tuning& get_kernel_tuning(device_id id) const;
+	// measure the candidate work-group sizes and items per thread for each element size and fragment class on each device, and use the fastest from now on
+	// this uses the device buffers, and must not run concurrently with any copies
+	void autotune_kernel_copies();
+	// go back to the preferred work-group size and one element per work item for all kernel copies
+	void reset_kernel_tuning();
+
 	enum class possibility {
 		possible,
 		needs_2d_copy,
@@ -62,10 +141,42 @@ class executor {
 
 	void barrier();
 
+	// the persistent workers executing the plans of copy sets; worker i submits to queue i of each device
+	work_stealing_scheduler& get_scheduler() { return *scheduler; }
+	// performs host to host copies, in parallel for large ones
+	host_copy_engine& get_host_copy_engine() { return *host_copies; }
+	// make an application-owned buffer known to the executor, which validates copies against it and selects copy paths based on its kind
+	// the executor's own buffers are registered automatically when they are allocated
+	void register_buffer(void* ptr, int64_t size, device_id did, memory_kind kind);
+	void unregister_buffer(void* ptr);
+	// page-lock existing host memory (e.g. a shared memory mapping) for transfers from and to the devices, where the SYCL implementation allows it,
+	// and register it; returns the kind it is registered as, which is host_pageable if devices can not access it directly
+	memory_kind pin_host_buffer(void* ptr, int64_t size);
+	// unregister and unpin host memory pinned with pin_host_buffer
+	void unpin_host_buffer(void* ptr);
+	const buffer_registry& get_registry() const { return registry; }
+
+	// the kind of memory at the given address: as registered, or as reported by the SYCL runtime (unknown host memory is pageable)
+	memory_kind get_memory_kind(const void* ptr, device_id did) const;
+
+	// hands out the staging buffers of all devices to the copies being executed
+	staging_pool& get_staging_pool() { return *staging; }
+
   private:
 	mutable device_list devices; // Mutable due to ext_oneapi_can_access_peer not being const; very ugly
 	std::vector<sycl::device> gpu_devices;
 	int64_t buffer_size;
+	buffer_init host_buffer_init;
+	mutable std::mutex buffer_mutex; // protects the lazy allocation of the device buffers and their placement information
+
+	buffer_registry registry;
+
+	enum class buffer_role { device, device_staging, host, host_staging };
+	std::byte* get_or_allocate_buffer(device_id id, buffer_role role);
+
+	std::unique_ptr<host_copy_engine> host_copies;
+	std::unique_ptr<staging_pool> staging;
+	std::unique_ptr<work_stealing_scheduler> scheduler; // declared last, so that workers are stopped before the devices are released
 };
 
 
@@ -76,4 +187,97 @@ void execute_copy(executor& exec, const copy_plan& plan);
 
 void execute_copy(executor& exec, const parallel_copy_set& set);
 
+// handle to a copy set executing asynchronously; copies of a handle refer to the same execution
+class copy_handle {
+  public:
+	struct state;
+
+	copy_handle() = default; // an empty handle refers to an already completed (empty) copy
+	explicit copy_handle(std::shared_ptr<state> s) : copy_state(std::move(s)) {}
+
+	// block until all copies, including their device operations, are complete
+	void wait() const;
+	// check for completion without blocking
+	bool test() const;
+	// register a function to be called once the copy set is complete; it is called immediately if it already is
+	// otherwise, it is called on the executor thread completing the copy set (before wait() returns), and should not block
+	void then(std::function<void()> continuation) const;
+	// an event which completes once all work of the copy set on the given device is done, for use as a dependency of application kernels
+	// empty if the copy set did not submit work to the device; blocks until the copy set is fully submitted (but not completed)
+	std::optional<sycl::event> get_event(device_id did) const;
+	// estimated imbalance of the initial distribution of plans across the executor's queues (see plan_partition::imbalance)
+	double get_imbalance() const;
+
+  private:
+	std::shared_ptr<state> copy_state;
+};
+
+// start executing the copy set, and return immediately with a handle to its completion
+copy_handle execute_copy_async(executor& exec, const parallel_copy_set& set);
+
+// a copy set prepared for repeated execution: its staging is placed and held until it is destroyed, its plans are assigned to the executor's workers,
+// and the descriptor tables of batched kernel copies are written and uploaded once; executions of a compiled set must not overlap
+// the held staging is long-lived (see staging_pool::acquire): copies whose staging does not fit next to it fail rather than waiting for it
+class compiled_copy_set {
+  public:
+	struct state;
+
+	compiled_copy_set() = default; // an empty set has no copies
+	explicit compiled_copy_set(std::shared_ptr<const state> s) : compiled_state(std::move(s)) {}
+
+	// estimated imbalance of the distribution of plans across the executor's queues (see plan_partition::imbalance)
+	double get_imbalance() const;
+
+  private:
+	std::shared_ptr<const state> compiled_state;
+
+	friend copy_handle execute_copy_async(executor& exec, const parallel_copy_set& set);
+	friend copy_handle execute_copy_async(executor& exec, const compiled_copy_set& set);
+};
+
+// validate the copy set and prepare it for execution; nothing is executed yet
+compiled_copy_set compile(executor& exec, const parallel_copy_set& set);
+
+// execute a compiled copy set, which only submits its copies
+void execute_copy(executor& exec, const compiled_copy_set& set);
+copy_handle execute_copy_async(executor& exec, const compiled_copy_set& set);
+
+// a copy set recorded for repeated execution: its staging is placed once and held by the graph, and its plans are assigned to queues,
+// so that a replay only submits the copies; a graph must not outlive the executor it was recorded on
+// the held staging is long-lived (see staging_pool::acquire): copies whose staging does not fit next to it fail rather than waiting for it
+class copy_graph {
+  public:
+	struct state;
+
+	copy_graph() = default; // an empty graph records no copies
+	explicit copy_graph(std::shared_ptr<state> s) : graph_state(std::move(s)) {}
+
+	// the distinct base pointers of the (non-staging) layouts of the recorded copy set, in order of first appearance
+	const std::vector<intptr_t>& get_base_pointers() const;
+	// whether replays without substituted base pointers submit SYCL command graphs, rather than the recorded submission list
+	bool uses_command_graph() const;
+
+  private:
+	std::shared_ptr<state> graph_state;
+
+	friend void replay(const copy_graph& graph, const std::vector<intptr_t>& new_base_pointers);
+};
+
+// record the copy set for replays; nothing is executed yet
+copy_graph record(executor& exec, const parallel_copy_set& set);
+
+// execute a recorded copy set and wait for its completion, substituting new_base_pointers for the base pointers of the graph (see get_base_pointers)
+// if any are given; the new buffers need to be of the same kind and size, they are only checked against the executor's registered buffers
+// replays of the same graph share its staging, so concurrent ones are performed one after the other
+void replay(const copy_graph& graph, const std::vector<intptr_t>& new_base_pointers = {});
+
+// execute a copy set of uniform multi-step plans (e.g. a chunked staged copy) as a software pipeline:
+// each step runs on its own queue or host engine, so e.g. staging chunk i+1, transferring chunk i and unstaging chunk i-1 overlap;
+// staging memory is reused round-robin across `staging_slots` chunks in flight. Other sets are executed as by execute_copy.
+// pageable host memory is bounced through pinned staging first, so that host memcpys into one slot overlap with the DMA of another.
+void execute_copy_pipelined(executor& exec, const parallel_copy_set& set, int64_t staging_slots = 2);
+
+// route copies between pageable host memory (as known to the executor) and devices through the executor's pinned host staging
+parallel_copy_set bounce_pageable_host_memory(const executor& exec, const parallel_copy_set& set);
+
 } // namespace copylib
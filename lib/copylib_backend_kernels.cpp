@@ -1,21 +1,69 @@
 #include <copylib.hpp> // IWYU pragma: keep
 
+#include <chrono>
+
 namespace copylib {
 
 // Directly using CUDA threadIdx.x does NOT actually change performance
 #define INDEX_X idx.get_global_id(0)
 
+// launch a kernel, only going through a command group if there are dependencies (keeps instant submission possible otherwise)
+template <int Dims, typename KernelFun>
+sycl::event launch_kernel(sycl::queue& q, const sycl::nd_range<Dims>& ndr, const std::vector<sycl::event>& deps, KernelFun kernel) {
+	if(deps.empty()) { return q.parallel_for(ndr, kernel); }
+	return q.submit([&](sycl::handler& cgh) {
+		cgh.depends_on(deps);
+		cgh.parallel_for(ndr, kernel);
+	});
+}
+
+// a 2D launch over fragments x elements within a fragment, which does not need a division per element to find its fragment
+// work-groups span the fragment length rounded up to a power of two (up to the preferred size) and as many fragments as fit the rest of the preferred size
+// returns nothing if the padding this requires would cost more work items than the divisions save
+template <typename IdxType>
+std::optional<sycl::nd_range<2>> get_fragment_nd_range(IdxType fragment_count, IdxType frag_elems, IdxType preferred_wg_size) {
+	if(fragment_count < 2 || frag_elems < 2) { return std::nullopt; }
+	IdxType wg_cols = 1;
+	while(wg_cols < frag_elems && wg_cols * 2 <= preferred_wg_size) {
+		wg_cols *= 2;
+	}
+	const IdxType wg_rows = std::max(preferred_wg_size / wg_cols, IdxType{1});
+	const IdxType cols = (frag_elems + wg_cols - 1) / wg_cols * wg_cols;
+	const IdxType rows = (fragment_count + wg_rows - 1) / wg_rows * wg_rows;
+	// at most one third of the work items idle (launched at most 1.5x the used ones)
+	if(2 * int64_t{rows} * cols > 3 * int64_t{fragment_count} * frag_elems) { return std::nullopt; }
+	return sycl::nd_range<2>{{static_cast<size_t>(rows), static_cast<size_t>(cols)}, {static_cast<size_t>(wg_rows), static_cast<size_t>(wg_cols)}};
+}
+
+// launch fun(i) for each i in [0, extent): each work item handles config.items_per_thread elements, a global range apart so that accesses stay coalesced
+// the range is padded to whole work-groups, so the work-group size does not need to divide the extent
+template <typename IdxType, typename ElementFun>
+sycl::event launch_elementwise(sycl::queue& q, IdxType extent, const kernel_config& config, const std::vector<sycl::event>& deps, ElementFun fun) {
+	const IdxType wg_size = config.wg_size;
+	const IdxType items_per_thread = config.items_per_thread;
+	const IdxType work_items = (extent + items_per_thread - 1) / items_per_thread;
+	const IdxType global_size = (work_items + wg_size - 1) / wg_size * wg_size;
+	const sycl::nd_range<1> ndr{static_cast<size_t>(global_size), static_cast<size_t>(wg_size)};
+	if(items_per_thread == 1) {
+		return launch_kernel(q, ndr, deps, [=]([[maybe_unused]] sycl::nd_item<1> idx) {
+			const IdxType i = INDEX_X;
+			if(i < extent) { fun(i); }
+		});
+	}
+	return launch_kernel(q, ndr, deps, [=]([[maybe_unused]] sycl::nd_item<1> idx) {
+		for(IdxType k = 0; k < items_per_thread; k++) {
+			const IdxType i = static_cast<IdxType>(INDEX_X) + k * global_size;
+			if(i < extent) { fun(i); }
+		}
+	});
+}
+
 template <typename T, typename IdxType>
-void copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, IdxType preferred_wg_size) {
+sycl::event copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, const kernel_config& config, const std::vector<sycl::event>& deps) {
 	const T* src = reinterpret_cast<T*>(spec.source_layout.base_ptr() + spec.source_layout.offset);
 	T* tgt = reinterpret_cast<T*>(spec.target_layout.base_ptr() + spec.target_layout.offset);
 
 	const IdxType extent = spec.source_layout.total_bytes() / sizeof(T);
-	IdxType wg_size = preferred_wg_size;
-	while(extent % wg_size != 0) {
-		wg_size /= 2;
-	}
-	const sycl::nd_range<1> ndr{static_cast<size_t>(extent), static_cast<size_t>(wg_size)};
 	if(spec.source_layout.fragment_count == spec.target_layout.fragment_count) {
 		const IdxType frag_elems = spec.source_layout.fragment_length / sizeof(T);
 		const IdxType src_stride = spec.source_layout.effective_stride() / sizeof(T);
@@ -23,28 +71,31 @@ void copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, IdxType prefer
 		// sadly, all this sillyness is actually measurably faster, and the cases are very common
 		if(frag_elems == 1) {
 			if(tgt_stride == 1) {
-				q.parallel_for(ndr, [=]([[maybe_unused]] sycl::nd_item<1> idx) { //
-					const IdxType i = INDEX_X;
+				return launch_elementwise(q, extent, config, deps, [=](IdxType i) { //
 					const IdxType src_i = i * src_stride;
 					tgt[i] = src[src_i];
 				});
 			} else if(src_stride == 1) {
-				q.parallel_for(ndr, [=]([[maybe_unused]] sycl::nd_item<1> idx) { //
-					const IdxType i = INDEX_X;
+				return launch_elementwise(q, extent, config, deps, [=](IdxType i) { //
 					const IdxType tgt_i = i * tgt_stride;
 					tgt[tgt_i] = src[i];
 				});
 			} else {
-				q.parallel_for(ndr, [=]([[maybe_unused]] sycl::nd_item<1> idx) { //
-					const IdxType i = INDEX_X;
+				return launch_elementwise(q, extent, config, deps, [=](IdxType i) { //
 					const IdxType src_i = i * src_stride;
 					const IdxType tgt_i = i * tgt_stride;
 					tgt[tgt_i] = src[src_i];
 				});
 			}
+		} else if(const auto ndr_2D = get_fragment_nd_range<IdxType>(spec.source_layout.fragment_count, frag_elems, config.wg_size)) {
+			const IdxType fragment_count = spec.source_layout.fragment_count;
+			return launch_kernel(q, *ndr_2D, deps, [=](sycl::nd_item<2> idx) {
+				const IdxType frag = idx.get_global_id(0);
+				const IdxType id_in_frag = idx.get_global_id(1);
+				if(frag < fragment_count && id_in_frag < frag_elems) { tgt[frag * tgt_stride + id_in_frag] = src[frag * src_stride + id_in_frag]; }
+			});
 		} else {
-			q.parallel_for(ndr, [=]([[maybe_unused]] sycl::nd_item<1> idx) {
-				const IdxType i = INDEX_X;
+			return launch_elementwise(q, extent, config, deps, [=](IdxType i) {
 				const IdxType frag = i / frag_elems;
 				const IdxType id_in_frag = i % frag_elems;
 				tgt[frag * tgt_stride + id_in_frag] = src[frag * src_stride + id_in_frag];
@@ -55,8 +106,7 @@ void copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, IdxType prefer
 		const IdxType tgt_frag_elems = spec.target_layout.fragment_length / sizeof(T);
 		const IdxType src_stride = spec.source_layout.effective_stride() / sizeof(T);
 		const IdxType tgt_stride = spec.target_layout.effective_stride() / sizeof(T);
-		q.parallel_for(ndr, [=]([[maybe_unused]] sycl::nd_item<1> idx) {
-			const IdxType i = INDEX_X;
+		return launch_elementwise(q, extent, config, deps, [=](IdxType i) {
 			const IdxType src_frag = i / src_frag_elems;
 			const IdxType tgt_frag = i / tgt_frag_elems;
 			tgt[tgt_frag * tgt_stride + i % tgt_frag_elems] = src[src_frag * src_stride + i % src_frag_elems];
@@ -65,35 +115,355 @@ void copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, IdxType prefer
 }
 
 template <typename T>
-void copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size) {
+sycl::event copy_with_kernel_impl(sycl::queue& q, const copy_spec& spec, const kernel_config& config, const std::vector<sycl::event>& deps) {
 	int64_t max = std::numeric_limits<int32_t>::max();
 	if(spec.source_layout.fragment_count < max && spec.source_layout.fragment_count < max && spec.source_layout.effective_stride() < max
 	    && spec.target_layout.effective_stride() < max && spec.source_layout.fragment_length < max && spec.target_layout.fragment_length < max) {
-		copy_with_kernel_impl<T, int32_t>(q, spec, preferred_wg_size);
+		return copy_with_kernel_impl<T, int32_t>(q, spec, config, deps);
 	} else {
-		copy_with_kernel_impl<T, int64_t>(q, spec, preferred_wg_size);
+		return copy_with_kernel_impl<T, int64_t>(q, spec, config, deps);
+	}
+}
+
+// call fun with a value of the element type of the given size
+template <typename Fun>
+auto with_element_type(int64_t element_size, Fun fun) {
+	switch(element_size) {
+	case sizeof(sycl::int16): return fun(sycl::int16{});
+	case sizeof(sycl::int8): return fun(sycl::int8{});
+	case sizeof(sycl::int4): return fun(sycl::int4{});
+	case sizeof(sycl::int2): return fun(sycl::int2{});
+	case sizeof(int32_t): return fun(int32_t{});
+	case sizeof(int16_t): return fun(int16_t{});
+	default: return fun(int8_t{});
+	}
+}
+
+// the class of the (shorter) fragments of a copy spec, in elements of the given size
+fragment_class get_fragment_class(const copy_spec& spec, int64_t element_size) {
+	return get_fragment_class(std::min(spec.source_layout.fragment_length, spec.target_layout.fragment_length) / element_size);
+}
+
+namespace {
+	// below this many bytes in the aligned body, the extra launches for the head and tail outweigh the gains of wider element types
+	constexpr int64_t min_peeled_body_bytes = 16 * 1024;
+
+	// the widest element type size (of the ones supported below) that divides all of the given sizes, strides and addresses
+	int64_t get_widest_element_size(std::initializer_list<int64_t> values) {
+		for(const int64_t size : {sizeof(sycl::int16), sizeof(sycl::int8), sizeof(sycl::int4), sizeof(sycl::int2), sizeof(int32_t), sizeof(int16_t)}) {
+			if(std::ranges::all_of(values, [size](int64_t v) { return v % size == 0; })) { return size; }
+		}
+		return 1;
+	}
+
+	// the element size usable for a copy spec as is: fragment lengths, strides and start addresses on both ends need to be aligned to it
+	int64_t get_element_size(const copy_spec& spec) {
+		const auto& src = spec.source_layout;
+		const auto& tgt = spec.target_layout;
+		return get_widest_element_size({src.fragment_length, tgt.fragment_length, src.fragment_count > 1 ? src.effective_stride() : 0,
+		    tgt.fragment_count > 1 ? tgt.effective_stride() : 0, reinterpret_cast<intptr_t>(src.base_ptr() + src.offset),
+		    reinterpret_cast<intptr_t>(tgt.base_ptr() + tgt.offset)});
+	}
+
+	sycl::event copy_with_kernel_of_size(
+	    sycl::queue& q, const copy_spec& spec, int64_t element_size, const kernel_tuning& tuning, const std::vector<sycl::event>& deps) {
+		return with_element_type(element_size, [&]<typename T>(T) {
+			return copy_with_kernel_impl<T>(q, spec, tuning.get(sizeof(T), get_fragment_class(spec, sizeof(T))), deps);
+		});
+	}
+
+	// the part [begin, begin + length) of each fragment of a copy between layouts with the same fragments
+	copy_spec get_fragment_slice(const copy_spec& spec, int64_t begin, int64_t length) {
+		const auto slice = [&](const data_layout& layout) {
+			return data_layout{layout.base, layout.offset + begin, length, layout.fragment_count, layout.effective_stride()};
+		};
+		return copy_spec{spec.source_device, slice(spec.source_layout), spec.target_device, slice(spec.target_layout), spec.properties};
+	}
+} // namespace
+
+sycl::event copy_with_kernel(sycl::queue& q, const copy_spec& spec, const kernel_tuning& tuning, const std::vector<sycl::event>& deps) {
+	const auto element_size = get_element_size(spec);
+
+	// if source and target are misaligned by the same amount in each fragment, peel the unaligned head and tail bytes of each fragment off into
+	// separate (narrow) copies, so that the bulk of the data is copied with a wider element type
+	const auto& src = spec.source_layout;
+	const auto& tgt = spec.target_layout;
+	if(src.fragment_count == tgt.fragment_count && src.fragment_length == tgt.fragment_length) {
+		const auto src_address = reinterpret_cast<intptr_t>(src.base_ptr() + src.offset);
+		const auto tgt_address = reinterpret_cast<intptr_t>(tgt.base_ptr() + tgt.offset);
+		const bool strided = src.fragment_count > 1;
+		const auto peeled_element_size = get_widest_element_size({
+		    src_address - tgt_address, strided ? src.effective_stride() : 0, strided ? tgt.effective_stride() : 0});
+		const auto head = std::min((peeled_element_size - src_address % peeled_element_size) % peeled_element_size, src.fragment_length);
+		const auto body = (src.fragment_length - head) / peeled_element_size * peeled_element_size;
+		const auto tail = src.fragment_length - head - body;
+		if(peeled_element_size >= 4 * element_size && body * src.fragment_count >= min_peeled_body_bytes) {
+			// the queue is in-order, so only the first copy needs to wait for the dependencies, and the last event covers all of them
+			sycl::event last;
+			std::vector<sycl::event> first_deps = deps;
+			if(head > 0) {
+				last = copy_with_kernel(q, get_fragment_slice(spec, 0, head), tuning, first_deps);
+				first_deps.clear();
+			}
+			last = copy_with_kernel_of_size(q, get_fragment_slice(spec, head, body), peeled_element_size, tuning, first_deps);
+			if(tail > 0) { last = copy_with_kernel(q, get_fragment_slice(spec, head + body, tail), tuning, {}); }
+			return last;
+		}
+	}
+
+	return copy_with_kernel_of_size(q, spec, element_size, tuning, deps);
+}
+
+// the amount of data copied to time a kernel configuration, enough to saturate the device
+constexpr int64_t max_tuning_bytes = 16 * 1024 * 1024;
+
+kernel_config tune_kernel_copy(sycl::queue& q, std::byte* buffer, int64_t buffer_size, int64_t element_size, fragment_class fragments,
+    const std::vector<kernel_config>& candidates) {
+	// a strided source is linearized into the second half of the buffer, which is how staging uses kernels most of the time
+	const int64_t fragment_elems = get_representative_fragment_elements(fragments);
+	const int64_t fragment_length = fragment_elems * element_size;
+	const int64_t bytes = std::min(buffer_size / 4, max_tuning_bytes) / fragment_length * fragment_length;
+	COPYLIB_ENSURE(bytes > 0, "Buffer of {} bytes too small to tune kernel copies of {} byte fragments", buffer_size, fragment_length);
+	const auto base = reinterpret_cast<intptr_t>(buffer);
+	const copy_spec spec{device_id::d0, {base, 0, fragment_length, bytes / fragment_length, 2 * fragment_length}, device_id::d0, {base, buffer_size / 2, bytes}};
+
+	constexpr int repetitions = 5;
+	kernel_config best = candidates.front();
+	auto best_time = std::chrono::steady_clock::duration::max();
+	for(const auto& config : candidates) {
+		const auto copy = [&] { return with_element_type(element_size, [&]<typename T>(T) { return copy_with_kernel_impl<T>(q, spec, config, {}); }); };
+		copy().wait_and_throw(); // warm-up
+		auto time = std::chrono::steady_clock::duration::max();
+		for(int i = 0; i < repetitions; i++) {
+			const auto start = std::chrono::steady_clock::now();
+			copy().wait_and_throw();
+			time = std::min(time, std::chrono::steady_clock::now() - start);
+		}
+		if(time < best_time) {
+			best_time = time;
+			best = config;
+		}
 	}
+	return best;
 }
 
-void copy_with_kernel(sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size) {
-	// case distinction based on fragment size
-	const auto smaller_fragment_size = std::min(spec.source_layout.fragment_length, spec.target_layout.fragment_length);
-	const auto smaller_stride = std::min(spec.source_layout.effective_stride(), spec.target_layout.effective_stride());
-	if(smaller_fragment_size % sizeof(sycl::int16) == 0 && smaller_stride % sizeof(sycl::int16) == 0) {
-		copy_with_kernel_impl<sycl::int16>(q, spec, preferred_wg_size);
-	} else if(smaller_fragment_size % sizeof(sycl::int8) == 0 && smaller_stride % sizeof(sycl::int8) == 0) {
-		copy_with_kernel_impl<sycl::int8>(q, spec, preferred_wg_size);
-	} else if(smaller_fragment_size % sizeof(sycl::int4) == 0 && smaller_stride % sizeof(sycl::int4) == 0) {
-		copy_with_kernel_impl<sycl::int4>(q, spec, preferred_wg_size);
-	} else if(smaller_fragment_size % sizeof(sycl::int2) == 0 && smaller_stride % sizeof(sycl::int2) == 0) {
-		copy_with_kernel_impl<sycl::int2>(q, spec, preferred_wg_size);
-	} else if(smaller_fragment_size % sizeof(int32_t) == 0 && smaller_stride % sizeof(int32_t) == 0) {
-		copy_with_kernel_impl<int32_t>(q, spec, preferred_wg_size);
-	} else if(smaller_fragment_size % sizeof(int16_t) == 0 && smaller_stride % sizeof(int16_t) == 0) {
-		copy_with_kernel_impl<int16_t>(q, spec, preferred_wg_size);
+namespace {
+	// one copy of a batch, in elements of the batch's element type
+	struct batched_copy {
+		const std::byte* src;
+		std::byte* tgt;
+		int64_t src_frag_elems;
+		int64_t src_stride;
+		int64_t tgt_frag_elems;
+		int64_t tgt_stride;
+		int64_t first_elem; // the number of elements in all preceding copies of the batch
+	};
+
+	// write the descriptor table of a batch to host_table, and return the total number of elements copied
+	template <typename T>
+	int64_t write_batched_copy_table_impl(const std::vector<copy_spec>& specs, std::byte* host_table) {
+		auto table = reinterpret_cast<batched_copy*>(host_table);
+		int64_t total_elems = 0;
+		for(size_t i = 0; i < specs.size(); i++) {
+			const auto& src = specs[i].source_layout;
+			const auto& tgt = specs[i].target_layout;
+			table[i] = batched_copy{src.base_ptr() + src.offset, tgt.base_ptr() + tgt.offset, src.fragment_length / static_cast<int64_t>(sizeof(T)),
+			    src.effective_stride() / static_cast<int64_t>(sizeof(T)), tgt.fragment_length / static_cast<int64_t>(sizeof(T)),
+			    tgt.effective_stride() / static_cast<int64_t>(sizeof(T)), total_elems};
+			total_elems += src.total_bytes() / static_cast<int64_t>(sizeof(T));
+		}
+		return total_elems;
+	}
+
+	template <typename T>
+	sycl::event launch_batched_copy_impl(sycl::queue& q, const std::byte* device_table, int64_t copy_count, int64_t total_elems, int32_t preferred_wg_size,
+	    const std::vector<sycl::event>& deps) {
+		// work is distributed evenly across the elements of all copies; each work item finds its copy by binary search over the prefix sums
+		const int64_t wg_size = preferred_wg_size;
+		const int64_t global_size = (total_elems + wg_size - 1) / wg_size * wg_size;
+		const sycl::nd_range<1> ndr{static_cast<size_t>(global_size), static_cast<size_t>(wg_size)};
+		const auto copies = reinterpret_cast<const batched_copy*>(device_table);
+		return launch_kernel(q, ndr, deps, [=](sycl::nd_item<1> idx) {
+			const int64_t i = INDEX_X;
+			if(i >= total_elems) { return; }
+			int64_t lo = 0, hi = copy_count - 1;
+			while(lo < hi) {
+				const int64_t mid = (lo + hi + 1) / 2;
+				if(copies[mid].first_elem <= i) {
+					lo = mid;
+				} else {
+					hi = mid - 1;
+				}
+			}
+			const batched_copy& c = copies[lo];
+			const int64_t j = i - c.first_elem;
+			const int64_t src_i = j / c.src_frag_elems * c.src_stride + j % c.src_frag_elems;
+			const int64_t tgt_i = j / c.tgt_frag_elems * c.tgt_stride + j % c.tgt_frag_elems;
+			reinterpret_cast<T*>(c.tgt)[tgt_i] = reinterpret_cast<const T*>(c.src)[src_i];
+		});
+	}
+} // namespace
+
+int64_t get_batched_copy_table_size(int64_t copy_count) { return copy_count * static_cast<int64_t>(sizeof(batched_copy)); }
+
+batched_kernel_copy write_batched_copy_table(const std::vector<copy_spec>& specs, std::byte* host_table) {
+	// all copies of the batch use the same element type, the widest one all of them allow
+	int64_t element_size = sizeof(sycl::int16);
+	for(const auto& spec : specs) {
+		element_size = std::min(element_size, get_element_size(spec));
+	}
+	const auto total_elems = with_element_type(element_size, [&]<typename T>(T) { return write_batched_copy_table_impl<T>(specs, host_table); });
+	return {element_size, static_cast<int64_t>(specs.size()), total_elems};
+}
+
+sycl::event launch_batched_copy(
+    sycl::queue& q, const batched_kernel_copy& batch, const std::byte* device_table, int32_t preferred_wg_size, const std::vector<sycl::event>& deps) {
+	return with_element_type(batch.element_size, [&]<typename T>(T) {
+		return launch_batched_copy_impl<T>(q, device_table, batch.copy_count, batch.total_elems, preferred_wg_size, deps);
+	});
+}
+
+namespace {
+	// converts each element, between any fragmentations of the source and target layouts into whole elements
+	template <typename SourceT, typename TargetT, typename ConvertFun>
+	sycl::event convert_with_kernel_impl(
+	    sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size, const std::vector<sycl::event>& deps, ConvertFun convert) {
+		const SourceT* src = reinterpret_cast<const SourceT*>(spec.source_layout.base_ptr() + spec.source_layout.offset);
+		TargetT* tgt = reinterpret_cast<TargetT*>(spec.target_layout.base_ptr() + spec.target_layout.offset);
+
+		const int64_t extent = spec.source_layout.total_bytes() / sizeof(SourceT);
+		const int64_t src_frag_elems = spec.source_layout.fragment_length / sizeof(SourceT);
+		const int64_t tgt_frag_elems = spec.target_layout.fragment_length / sizeof(TargetT);
+		const int64_t src_stride = spec.source_layout.effective_stride() / sizeof(SourceT);
+		const int64_t tgt_stride = spec.target_layout.effective_stride() / sizeof(TargetT);
+		// the conversion makes this compute- rather than index-bound, so the range is padded to whole work-groups instead of specialized
+		const int64_t wg_size = preferred_wg_size;
+		const sycl::nd_range<1> ndr{static_cast<size_t>((extent + wg_size - 1) / wg_size * wg_size), static_cast<size_t>(wg_size)};
+		return launch_kernel(q, ndr, deps, [=]([[maybe_unused]] sycl::nd_item<1> idx) {
+			const int64_t i = INDEX_X;
+			if(i >= extent) { return; }
+			tgt[i / tgt_frag_elems * tgt_stride + i % tgt_frag_elems] = convert(src[i / src_frag_elems * src_stride + i % src_frag_elems]);
+		});
+	}
+} // namespace
+
+sycl::event convert_with_kernel(sycl::queue& q, const copy_spec& spec, int32_t preferred_wg_size, const std::vector<sycl::event>& deps) {
+	switch(spec.conversion) {
+	case element_conversion::fp32_to_fp16:
+		return convert_with_kernel_impl<uint32_t, uint16_t>(q, spec, preferred_wg_size, deps, [](uint32_t f) { return fp32_to_fp16_bits(f); });
+	case element_conversion::fp32_to_bf16:
+		return convert_with_kernel_impl<uint32_t, uint16_t>(q, spec, preferred_wg_size, deps, [](uint32_t f) { return fp32_to_bf16_bits(f); });
+	case element_conversion::fp16_to_fp32:
+		return convert_with_kernel_impl<uint16_t, uint32_t>(q, spec, preferred_wg_size, deps, [](uint16_t h) { return fp16_to_fp32_bits(h); });
+	case element_conversion::bf16_to_fp32:
+		return convert_with_kernel_impl<uint16_t, uint32_t>(q, spec, preferred_wg_size, deps, [](uint16_t b) { return bf16_to_fp32_bits(b); });
+	default: COPYLIB_ERROR("Not an element conversion: {}", spec);
+	}
+}
+
+namespace {
+	// compressed staging suppresses blocks of zeros: the stream holds the indices of the non-zero blocks, followed by their contents in the same order
+	constexpr int64_t compression_block_size = 512;
+	constexpr int64_t compression_wg_size = 32;
+
+	// blocks are moved in 16 byte vectors where the alignment allows it
+	struct alignas(16) block_vector {
+		uint32_t elems[4];
+	};
+
+	int64_t get_compression_block_count(int64_t bytes) { return (bytes + compression_block_size - 1) / compression_block_size; }
+	int64_t get_compression_table_size(int64_t bytes) {
+		return (get_compression_block_count(bytes) * static_cast<int64_t>(sizeof(uint32_t)) + staging_pool::granularity - 1) / staging_pool::granularity
+		       * staging_pool::granularity;
+	}
+
+	template <typename T>
+	bool is_zero(const T& value) {
+		if constexpr(std::is_same_v<T, block_vector>) {
+			return (value.elems[0] | value.elems[1] | value.elems[2] | value.elems[3]) == 0;
+		} else {
+			return value == 0;
+		}
+	}
+
+	// with a table, each non-zero block is assigned the next slot of the stream through counter, and stored there; otherwise they are only counted
+	template <typename T>
+	sycl::event pack_nonzero_blocks_impl(
+	    sycl::queue& q, const std::byte* source, int64_t bytes, uint32_t* counter, std::byte* stream, const std::vector<sycl::event>& deps) {
+		const T* src = reinterpret_cast<const T*>(source);
+		uint32_t* table = reinterpret_cast<uint32_t*>(stream);
+		T* packed = stream == nullptr ? nullptr : reinterpret_cast<T*>(stream + get_compression_table_size(bytes));
+		const int64_t elems = bytes / sizeof(T);
+		const int64_t block_elems = compression_block_size / sizeof(T);
+		const int64_t block_count = get_compression_block_count(bytes);
+		const sycl::nd_range<1> ndr{static_cast<size_t>(block_count * compression_wg_size), static_cast<size_t>(compression_wg_size)};
+		return launch_kernel(q, ndr, deps, [=](sycl::nd_item<1> idx) {
+			const int64_t block = idx.get_group(0);
+			const int64_t local_id = idx.get_local_id(0);
+			const int64_t begin = block * block_elems;
+			const int64_t end = std::min(begin + block_elems, elems);
+			bool nonzero = false;
+			for(int64_t i = begin + local_id; i < end; i += compression_wg_size) {
+				nonzero = nonzero || !is_zero(src[i]);
+			}
+			if(!sycl::any_of_group(idx.get_group(), nonzero)) { return; }
+			uint32_t slot = 0;
+			if(local_id == 0) { slot = sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed, sycl::memory_scope::device>(*counter).fetch_add(1); }
+			if(packed == nullptr) { return; }
+			slot = sycl::group_broadcast(idx.get_group(), slot, 0);
+			if(local_id == 0) { table[slot] = block; }
+			for(int64_t i = begin + local_id; i < end; i += compression_wg_size) {
+				packed[slot * block_elems + i - begin] = src[i];
+			}
+		});
+	}
+
+	template <typename T>
+	sycl::event unpack_blocks_impl(
+	    sycl::queue& q, const std::byte* stream, int64_t packed_blocks, std::byte* target, int64_t bytes, const std::vector<sycl::event>& deps) {
+		const uint32_t* table = reinterpret_cast<const uint32_t*>(stream);
+		const T* packed = reinterpret_cast<const T*>(stream + get_compression_table_size(bytes));
+		T* tgt = reinterpret_cast<T*>(target);
+		const int64_t elems = bytes / sizeof(T);
+		const int64_t block_elems = compression_block_size / sizeof(T);
+		const sycl::nd_range<1> ndr{static_cast<size_t>(packed_blocks * compression_wg_size), static_cast<size_t>(compression_wg_size)};
+		return launch_kernel(q, ndr, deps, [=](sycl::nd_item<1> idx) {
+			const int64_t slot = idx.get_group(0);
+			const int64_t begin = table[slot] * block_elems;
+			const int64_t end = std::min(begin + block_elems, elems);
+			for(int64_t i = begin + static_cast<int64_t>(idx.get_local_id(0)); i < end; i += compression_wg_size) {
+				tgt[i] = packed[slot * block_elems + i - begin];
+			}
+		});
+	}
+
+	bool is_vector_aligned(const std::byte* a, const std::byte* b, int64_t bytes) {
+		return reinterpret_cast<intptr_t>(a) % sizeof(block_vector) == 0 && reinterpret_cast<intptr_t>(b) % sizeof(block_vector) == 0
+		       && bytes % sizeof(block_vector) == 0;
+	}
+} // namespace
+
+int64_t get_compressed_stream_size(int64_t bytes, int64_t packed_blocks) { return get_compression_table_size(bytes) + packed_blocks * compression_block_size; }
+
+sycl::event pack_nonzero_blocks(sycl::queue& q, const std::byte* source, int64_t bytes, uint32_t* counter, std::byte* stream, const std::vector<sycl::event>& deps) {
+	if(is_vector_aligned(source, stream, bytes)) { return pack_nonzero_blocks_impl<block_vector>(q, source, bytes, counter, stream, deps); }
+	return pack_nonzero_blocks_impl<uint8_t>(q, source, bytes, counter, stream, deps);
+}
+
+sycl::event unpack_blocks(sycl::queue& q, const std::byte* stream, int64_t packed_blocks, std::byte* target, int64_t bytes, const std::vector<sycl::event>& deps) {
+	// blocks which are not in the stream are zero
+	sycl::event cleared;
+	if(deps.empty()) {
+		cleared = q.memset(target, 0, bytes);
 	} else {
-		copy_with_kernel_impl<int8_t>(q, spec, preferred_wg_size);
+		cleared = q.submit([&](sycl::handler& cgh) {
+			cgh.depends_on(deps);
+			cgh.memset(target, 0, bytes);
+		});
 	}
+	if(packed_blocks == 0) { return cleared; }
+	if(is_vector_aligned(stream, target, bytes)) { return unpack_blocks_impl<block_vector>(q, stream, packed_blocks, target, bytes, {}); }
+	return unpack_blocks_impl<uint8_t>(q, stream, packed_blocks, target, bytes, {});
 }
 
 } // namespace copylib
@@ -6,9 +6,33 @@
 #include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <numeric>
+#include <optional>
 
 namespace copylib {
 
+int64_t get_source_element_size(element_conversion conversion) {
+	switch(conversion) {
+	case element_conversion::none: return 1;
+	case element_conversion::fp32_to_fp16:
+	case element_conversion::fp32_to_bf16: return 4;
+	case element_conversion::fp16_to_fp32:
+	case element_conversion::bf16_to_fp32: return 2;
+	default: COPYLIB_ERROR("Unknown element conversion: {}", conversion);
+	}
+}
+
+int64_t get_target_element_size(element_conversion conversion) {
+	switch(conversion) {
+	case element_conversion::none: return 1;
+	case element_conversion::fp32_to_fp16:
+	case element_conversion::fp32_to_bf16: return 2;
+	case element_conversion::fp16_to_fp32:
+	case element_conversion::bf16_to_fp32: return 4;
+	default: COPYLIB_ERROR("Unknown element conversion: {}", conversion);
+	}
+}
+
 bool is_valid(const data_layout& layout) { //
 	return layout.fragment_length > 0 && layout.fragment_count > 0
 	       && (layout.stride >= layout.fragment_length ||
@@ -29,9 +53,22 @@ bool is_valid(const copy_spec& plan) {
 	if(plan.properties & copy_properties::use_2D_copy && plan.properties & copy_properties::use_kernel) { return false; }
 	// for native 2D copies the fragment lengths must match
 	if(plan.properties & copy_properties::use_2D_copy && plan.source_layout.fragment_length != plan.target_layout.fragment_length) { return false; }
+	// compressed data is only transferred between contiguous device and host staging layouts
+	if(plan.properties & copy_properties::use_compression) {
+		if((plan.source_device == device_id::host) == (plan.target_device == device_id::host) || !plan.is_contiguous()) { return false; }
+		if(plan.properties & copy_properties::use_2D_copy || plan.conversion != element_conversion::none) { return false; }
+	}
+	// element conversions need a kernel, and fragments of whole elements
+	const auto source_element_size = get_source_element_size(plan.conversion);
+	const auto target_element_size = get_target_element_size(plan.conversion);
+	if(plan.conversion != element_conversion::none) {
+		if(plan.properties & copy_properties::use_2D_copy) { return false; }
+		if(plan.source_layout.fragment_length % source_element_size != 0 || plan.source_layout.effective_stride() % source_element_size != 0) { return false; }
+		if(plan.target_layout.fragment_length % target_element_size != 0 || plan.target_layout.effective_stride() % target_element_size != 0) { return false; }
+	}
 	// the layouts must be valid and compatible
 	return is_valid(plan.source_layout) && is_valid(plan.target_layout) //
-	       && plan.source_layout.total_bytes() == plan.target_layout.total_bytes();
+	       && plan.source_layout.total_bytes() / source_element_size == plan.target_layout.total_bytes() / target_element_size;
 }
 
 bool is_valid(const copy_plan& plan) {
@@ -153,15 +190,15 @@ parallel_copy_set apply_chunking(const copy_spec& spec, const copy_strategy& str
 		const auto fragments_per_chunk = strategy.chunk_size / spec.target_layout.fragment_length;
 		const auto num_chunks = spec.target_layout.fragment_count / fragments_per_chunk + //
 		                        (spec.target_layout.fragment_count % fragments_per_chunk != 0 ? 1 : 0);
-		const auto total_bytes_per_chunk = spec.target_layout.fragment_length * fragments_per_chunk;
 		for(int64_t i = 0; i < num_chunks; i++) {
 			const auto start_fragment = i * fragments_per_chunk;
 			const auto end_fragment = std::min(start_fragment + fragments_per_chunk, spec.target_layout.fragment_count);
 			const auto num_fragments = end_fragment - start_fragment;
 			const auto source_offset = spec.source_layout.offset + start_fragment * spec.target_layout.fragment_length;
 			const auto dest_offset = spec.target_layout.fragment_offset(start_fragment);
-			copy_set.push_back({{                                                                          //
-			    spec.source_device, {spec.source_layout.base, source_offset, total_bytes_per_chunk, 1, 0}, //
+			const auto chunk_bytes = num_fragments * spec.target_layout.fragment_length;
+			copy_set.push_back({{                                                                //
+			    spec.source_device, {spec.source_layout.base, source_offset, chunk_bytes, 1, 0}, //
 			    spec.target_device, {spec.target_layout.base, dest_offset, spec.target_layout.fragment_length, num_fragments, spec.target_layout.stride}}});
 		}
 		return copy_set;
@@ -174,16 +211,16 @@ parallel_copy_set apply_chunking(const copy_spec& spec, const copy_strategy& str
 		const auto fragments_per_chunk = strategy.chunk_size / spec.source_layout.fragment_length;
 		const auto num_chunks = spec.source_layout.fragment_count / fragments_per_chunk + //
 		                        (spec.source_layout.fragment_count % fragments_per_chunk != 0 ? 1 : 0);
-		const auto total_bytes_per_chunk = spec.source_layout.fragment_length * fragments_per_chunk;
 		for(int64_t i = 0; i < num_chunks; i++) {
 			const auto start_fragment = i * fragments_per_chunk;
 			const auto end_fragment = std::min(start_fragment + fragments_per_chunk, spec.source_layout.fragment_count);
 			const auto num_fragments = end_fragment - start_fragment;
 			const auto source_offset = spec.source_layout.fragment_offset(start_fragment);
 			const auto dest_offset = spec.target_layout.offset + start_fragment * spec.source_layout.fragment_length;
+			const auto chunk_bytes = num_fragments * spec.source_layout.fragment_length;
 			copy_set.push_back({{                                                                                                                           //
 			    spec.source_device, {spec.source_layout.base, source_offset, spec.source_layout.fragment_length, num_fragments, spec.source_layout.stride}, //
-			    spec.target_device, {spec.target_layout.base, dest_offset, total_bytes_per_chunk, 1, 0}}});
+			    spec.target_device, {spec.target_layout.base, dest_offset, chunk_bytes, 1, 0}}});
 		}
 		return copy_set;
 	}
@@ -257,6 +294,12 @@ namespace {
 
 copy_plan apply_staging(const copy_spec& spec, const copy_strategy& strategy, const staging_buffer_provider& staging_provider) {
 	COPYLIB_ENSURE(is_valid(spec), "Invalid copy specification, cannot stage: {}", spec);
+	// compression only applies to host staging, see apply_d2d_implementation
+	if(strategy.properties & copy_properties::use_compression) {
+		auto uncompressed_strategy = strategy;
+		uncompressed_strategy.properties = without(strategy.properties, copy_properties::use_compression);
+		return apply_staging(spec, uncompressed_strategy, staging_provider);
+	}
 	const auto proper_spec = apply_properties(spec, strategy.properties);
 	if(strategy.type == copy_type::direct) { return {proper_spec}; }
 	if(strategy.type != copy_type::staged) {
@@ -323,7 +366,7 @@ parallel_copy_set apply_staging(const parallel_copy_set& spec, const copy_strate
 	return copies;
 }
 
-copy_plan apply_d2d_implementation(const copy_plan& plan, const d2d_implementation d2d, const staging_buffer_provider& staging_provider) {
+copy_plan apply_d2d_implementation(const copy_plan& plan, const d2d_implementation d2d, const staging_buffer_provider& staging_provider, bool compressed) {
 	COPYLIB_ENSURE(is_valid(plan), "Invalid copy plan, cannot apply d2d implementation: {}", plan);
 	if(d2d == d2d_implementation::direct) { return plan; }
 	// we need to change any copies that go from a device to another device
@@ -332,21 +375,28 @@ copy_plan apply_d2d_implementation(const copy_plan& plan, const d2d_implementati
 		if(spec.source_device == spec.target_device || spec.source_device == device_id::host || spec.target_device == device_id::host) {
 			new_plan.push_back(spec);
 		} else {
+			// the copy to host staging compresses the data on the source device if that pays off, and the copy from it decompresses it on the target device
+			// the staged data follows the header, which tells whether it did
+			const bool compress = compressed && spec.is_contiguous() && spec.conversion == element_conversion::none
+			                      && (d2d == d2d_implementation::host_staging_at_source || d2d == d2d_implementation::host_staging_at_target);
+			const auto staging_offset = compress ? compressed_staging_header_size : 0;
+			const auto staging_size = staging_offset + spec.source_layout.total_bytes();
+			const auto staging_properties = compress ? spec.properties | copy_properties::use_compression : spec.properties;
 			switch(d2d) {
 			case d2d_implementation::host_staging_at_source: {
-				const auto staging_buffer = staging_provider(spec.source_device, true, spec.source_layout.total_bytes());
+				const auto staging_buffer = staging_provider(spec.source_device, true, staging_size);
 				const data_layout staged_layout = {
-				    staging_buffer, 0, spec.source_layout.fragment_length, spec.source_layout.fragment_count, spec.source_layout.stride};
-				new_plan.emplace_back(spec.source_device, spec.source_layout, device_id::host, staged_layout, spec.properties);
-				new_plan.emplace_back(device_id::host, staged_layout, spec.target_device, spec.target_layout, spec.properties);
+				    staging_buffer, staging_offset, spec.source_layout.fragment_length, spec.source_layout.fragment_count, spec.source_layout.stride};
+				new_plan.emplace_back(spec.source_device, spec.source_layout, device_id::host, staged_layout, staging_properties);
+				new_plan.emplace_back(device_id::host, staged_layout, spec.target_device, spec.target_layout, staging_properties);
 				break;
 			}
 			case d2d_implementation::host_staging_at_target: {
-				const auto staging_buffer = staging_provider(spec.target_device, true, spec.source_layout.total_bytes());
+				const auto staging_buffer = staging_provider(spec.target_device, true, staging_size);
 				const data_layout staged_layout = {
-				    staging_buffer, 0, spec.source_layout.fragment_length, spec.source_layout.fragment_count, spec.source_layout.stride};
-				new_plan.emplace_back(spec.source_device, spec.source_layout, device_id::host, staged_layout, spec.properties);
-				new_plan.emplace_back(device_id::host, staged_layout, spec.target_device, spec.target_layout, spec.properties);
+				    staging_buffer, staging_offset, spec.source_layout.fragment_length, spec.source_layout.fragment_count, spec.source_layout.stride};
+				new_plan.emplace_back(spec.source_device, spec.source_layout, device_id::host, staged_layout, staging_properties);
+				new_plan.emplace_back(device_id::host, staged_layout, spec.target_device, spec.target_layout, staging_properties);
 				break;
 			}
 			case d2d_implementation::host_staging_at_both: {
@@ -368,19 +418,182 @@ copy_plan apply_d2d_implementation(const copy_plan& plan, const d2d_implementati
 	return new_plan;
 }
 
-parallel_copy_set apply_d2d_implementation(const parallel_copy_set& copy_set, const d2d_implementation d2d, const staging_buffer_provider& staging_provider) {
+parallel_copy_set apply_d2d_implementation(
+    const parallel_copy_set& copy_set, const d2d_implementation d2d, const staging_buffer_provider& staging_provider, bool compressed) {
 	parallel_copy_set ret;
 	for(const auto& plan : copy_set) {
-		ret.push_back(apply_d2d_implementation(plan, d2d, staging_provider));
+		ret.push_back(apply_d2d_implementation(plan, d2d, staging_provider, compressed));
 	}
 	return ret;
 }
 
+copy_plan apply_host_bouncing(const copy_plan& plan, const pageable_predicate& is_pageable, const staging_buffer_provider& staging_provider) {
+	COPYLIB_ENSURE(is_valid(plan), "Invalid copy plan, cannot apply host bouncing: {}", plan);
+	const auto bounce = [&](device_id did, const data_layout& host_layout, const data_layout& device_layout) -> std::optional<data_layout> {
+		if(did == device_id::host || host_layout.is_unplaced_staging() || !is_pageable(host_layout)) { return std::nullopt; }
+		const auto stride = device_layout.effective_stride();
+		const auto staging_buffer = staging_provider(did, true, device_layout.fragment_count * stride);
+		return data_layout{staging_buffer, 0, device_layout.fragment_length, device_layout.fragment_count, stride};
+	};
+	copy_plan new_plan;
+	for(const auto& spec : plan) {
+		if(spec.source_device == device_id::host) {
+			if(const auto staged_layout = bounce(spec.target_device, spec.source_layout, spec.target_layout)) {
+				new_plan.emplace_back(device_id::host, spec.source_layout, device_id::host, *staged_layout, spec.properties);
+				new_plan.emplace_back(device_id::host, *staged_layout, spec.target_device, spec.target_layout, spec.properties);
+				continue;
+			}
+		} else if(spec.target_device == device_id::host) {
+			if(const auto staged_layout = bounce(spec.source_device, spec.target_layout, spec.source_layout)) {
+				new_plan.emplace_back(spec.source_device, spec.source_layout, device_id::host, *staged_layout, spec.properties);
+				new_plan.emplace_back(device_id::host, *staged_layout, device_id::host, spec.target_layout, spec.properties);
+				continue;
+			}
+		}
+		new_plan.push_back(spec);
+	}
+	return new_plan;
+}
+
+parallel_copy_set apply_host_bouncing(const parallel_copy_set& copy_set, const pageable_predicate& is_pageable, const staging_buffer_provider& staging_provider) {
+	parallel_copy_set ret;
+	for(const auto& plan : copy_set) {
+		ret.push_back(apply_host_bouncing(plan, is_pageable, staging_provider));
+	}
+	return ret;
+}
+
+copy_plan apply_element_conversion(const copy_spec& spec, const staging_buffer_provider& staging_provider) {
+	COPYLIB_ENSURE(is_valid(spec), "Invalid copy specification, cannot apply element conversion: {}", spec);
+	if(spec.conversion == element_conversion::none) { return {spec}; }
+	COPYLIB_ENSURE(spec.source_device != device_id::host || spec.target_device != device_id::host, "Element conversions need a device: {}", spec);
+	if(spec.source_device == spec.target_device) { return {spec.with_properties(copy_properties::use_kernel)}; }
+
+	const bool narrowing = get_target_element_size(spec.conversion) < get_source_element_size(spec.conversion);
+	const bool at_source = narrowing ? spec.source_device != device_id::host : spec.target_device == device_id::host;
+	if(at_source) {
+		const auto converted_bytes = spec.target_layout.total_bytes();
+		const data_layout converted_layout{staging_provider(spec.source_device, false, converted_bytes), 0, converted_bytes};
+		return {{spec.source_device, spec.source_layout, spec.source_device, converted_layout, copy_properties::use_kernel, spec.conversion},
+		    {spec.source_device, converted_layout, spec.target_device, spec.target_layout, spec.properties}};
+	}
+	const auto unconverted_bytes = spec.source_layout.total_bytes();
+	const data_layout unconverted_layout{staging_provider(spec.target_device, false, unconverted_bytes), 0, unconverted_bytes};
+	return {{spec.source_device, spec.source_layout, spec.target_device, unconverted_layout, spec.properties},
+	    {spec.target_device, unconverted_layout, spec.target_device, spec.target_layout, copy_properties::use_kernel, spec.conversion}};
+}
+
+bool is_direct_kernel_copy(const copy_spec& spec, const copy_strategy& strategy) {
+	if(spec.source_device != spec.target_device || spec.source_device == device_id::host) { return false; }
+	if(!(strategy.properties & copy_properties::use_kernel)) { return false; }
+	const auto& src = spec.source_layout;
+	const auto& tgt = spec.target_layout;
+	if(src.unit_stride() || tgt.unit_stride()) { return true; }
+	return std::max(src.fragment_length, tgt.fragment_length) % std::min(src.fragment_length, tgt.fragment_length) == 0;
+}
+
+namespace {
+	data_layout scale_layout(const data_layout& layout, int64_t numerator, int64_t denominator) {
+		return {layout.base, layout.offset * numerator / denominator, layout.fragment_length * numerator / denominator, layout.fragment_count,
+		    layout.stride * numerator / denominator};
+	}
+
+	parallel_copy_set manifest_converting_strategy(const copy_spec& spec, const copy_strategy& strategy, const staging_buffer_provider& staging_provider) {
+		COPYLIB_ENSURE(is_valid(spec), "Invalid copy specification, cannot manifest strategy: {}", spec);
+		// a single kernel performs conversions within a device
+		if(spec.source_device == spec.target_device) { return {apply_element_conversion(spec, staging_provider)}; }
+
+		// chunks are cut at element boundaries by chunking with the narrower side scaled up to the wider element size, and scaling it back down
+		const auto source_element_size = get_source_element_size(spec.conversion);
+		const auto target_element_size = get_target_element_size(spec.conversion);
+		const auto element_size = std::max(source_element_size, target_element_size);
+		copy_spec unconverted_spec{spec.source_device, scale_layout(spec.source_layout, element_size, source_element_size), spec.target_device,
+		    scale_layout(spec.target_layout, element_size, target_element_size)};
+		auto chunk_strategy = strategy;
+		if(strategy.chunk_size > 0) { chunk_strategy.chunk_size = std::max(strategy.chunk_size / element_size, int64_t{1}) * element_size; }
+
+		parallel_copy_set ret;
+		for(const auto& chunk : apply_chunking(unconverted_spec, chunk_strategy)) {
+			const copy_spec converted_chunk{chunk.front().source_device, scale_layout(chunk.front().source_layout, source_element_size, element_size),
+			    chunk.front().target_device, scale_layout(chunk.front().target_layout, target_element_size, element_size), copy_properties::none, spec.conversion};
+			copy_plan plan;
+			for(const auto& step : apply_element_conversion(converted_chunk, staging_provider)) {
+				if(step.conversion != element_conversion::none) {
+					plan.push_back(step);
+					continue;
+				}
+				const auto staged_step = apply_staging(step, strategy, staging_provider);
+				plan.insert(plan.end(), staged_step.begin(), staged_step.end());
+			}
+			ret.push_back(apply_d2d_implementation(plan, strategy.d2d, staging_provider, strategy.properties & copy_properties::use_compression));
+		}
+		return ret;
+	}
+} // namespace
+
 parallel_copy_set manifest_strategy(const copy_spec& spec, const copy_strategy& strategy, const staging_buffer_provider& staging_provider) {
+	if(spec.conversion != element_conversion::none) { return manifest_converting_strategy(spec, strategy, staging_provider); }
+	// staging within a device would only add a pass over the data when a kernel can copy between the layouts directly
+	const auto staging_strategy =
+	    is_direct_kernel_copy(spec, strategy) ? copy_strategy{copy_type::direct, strategy.properties, strategy.d2d, strategy.chunk_size} : strategy;
 	const auto chunked_copies = apply_chunking(spec, strategy);
-	const auto staged_copies = apply_staging(chunked_copies, strategy, staging_provider);
-	const auto finalized_copies = apply_d2d_implementation(staged_copies, strategy.d2d, staging_provider);
+	const auto staged_copies = apply_staging(chunked_copies, staging_strategy, staging_provider);
+	const auto finalized_copies = apply_d2d_implementation(staged_copies, strategy.d2d, staging_provider, strategy.properties & copy_properties::use_compression);
 	return finalized_copies;
 }
 
+namespace {
+	// overheads in byte-equivalents, roughly the amount of data that could be moved in the time it takes to launch an operation
+	constexpr int64_t step_overhead_bytes = 32 * 1024;
+	constexpr int64_t operation_overhead_bytes = 4 * 1024;
+
+	// number of individual operations the executor issues for a copy spec
+	int64_t operation_count(const copy_spec& spec) {
+		if(spec.is_contiguous()) { return 1; }
+		const bool host_involved = spec.source_device == device_id::host || spec.target_device == device_id::host;
+		if(spec.properties & copy_properties::use_2D_copy) { return 1; }
+		if(spec.properties & copy_properties::use_kernel && !host_involved) { return 1; }
+		// the host copy engine packs/unpacks small fragments in bulk
+		if(spec.source_device == device_id::host && spec.target_device == device_id::host && spec.source_layout.unit_stride() != spec.target_layout.unit_stride()) {
+			return 1;
+		}
+		return std::max(spec.source_layout.fragment_count, spec.target_layout.fragment_count);
+	}
+} // namespace
+
+int64_t estimate_cost(const copy_plan& plan) {
+	int64_t cost = 0;
+	for(const auto& spec : plan) {
+		cost += spec.source_layout.total_bytes() + step_overhead_bytes + operation_count(spec) * operation_overhead_bytes;
+	}
+	return cost;
+}
+
+double plan_partition::imbalance() const {
+	if(costs.empty()) { return 1.0; }
+	const auto total = std::accumulate(costs.begin(), costs.end(), int64_t{0});
+	if(total == 0) { return 1.0; }
+	const auto max = *std::ranges::max_element(costs);
+	return static_cast<double>(max) * static_cast<double>(costs.size()) / static_cast<double>(total);
+}
+
+plan_partition partition_by_cost(const parallel_copy_set& set, int64_t parts_count) {
+	COPYLIB_ENSURE(parts_count > 0, "Cannot partition into {} parts", parts_count);
+	std::vector<std::pair<int64_t, size_t>> plan_costs;
+	plan_costs.reserve(set.size());
+	for(size_t i = 0; i < set.size(); i++) {
+		plan_costs.emplace_back(estimate_cost(set[i]), i);
+	}
+	// most expensive first, ties in plan order
+	std::ranges::stable_sort(plan_costs, std::greater{}, [](const auto& pc) { return pc.first; });
+
+	plan_partition partition{std::vector<std::vector<size_t>>(parts_count), std::vector<int64_t>(parts_count, 0)};
+	for(const auto& [cost, plan_idx] : plan_costs) {
+		const auto cheapest = std::ranges::min_element(partition.costs) - partition.costs.begin();
+		partition.parts[cheapest].push_back(plan_idx);
+		partition.costs[cheapest] += cost;
+	}
+	return partition;
+}
+
 } // namespace copylib
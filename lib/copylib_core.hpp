@@ -5,10 +5,13 @@
 #include <sycl/sycl.hpp>
 
 #include <cstddef>
+#include <limits>
 
 namespace copylib {
 
+// devices are identified by their dense index in the executor, so that any number of them can be addressed; d0 to d7 name the first ones
 enum class device_id : int16_t {
+	none = -2, // no device, e.g. the queue of a copy that has not been performed yet
 	host = -1,
 	d0 = 0,
 	d1 = 1,
@@ -18,9 +21,14 @@ enum class device_id : int16_t {
 	d5 = 5,
 	d6 = 6,
 	d7 = 7,
-	count = 8,
 };
 
+// the id of the device with the given index in the executor, e.g. beyond d7
+inline device_id make_device_id(int64_t index) {
+	COPYLIB_ENSURE(index >= 0 && index <= std::numeric_limits<int16_t>::max(), "Invalid device index: {}", index);
+	return static_cast<device_id>(index);
+}
+
 #pragma pack(push, 0)
 struct staging_id {
 	constexpr static uint8_t staging_id_flag = 0b00000001;
@@ -91,9 +99,75 @@ enum class copy_properties {
 	none = 0x0000,
 	use_kernel = 0x0001,  // whether to use a kernel to perform the copy
 	use_2D_copy = 0x0010, // whether to use a native 2D copy operation, if available
+	// as part of a strategy: whether to compress the data staged in host memory by host_staging_at_source/target d2d implementations
+	// on copies between device and host (only created by apply_d2d_implementation): whether the host side holds the compressed data
+	use_compression = 0x0100,
+	// along with use_kernel: whether the kernel may access pinned or shared host memory directly (zero-copy, reading or writing it over the interconnect),
+	// rather than the host side being transferred with one copy per fragment
+	use_zero_copy = 0x1000,
 };
 inline copy_properties operator|(copy_properties a, copy_properties b) { return static_cast<copy_properties>(static_cast<int>(a) | static_cast<int>(b)); }
 inline bool operator&(copy_properties a, copy_properties b) { return static_cast<int>(a) & static_cast<int>(b); }
+inline copy_properties without(copy_properties a, copy_properties b) { return static_cast<copy_properties>(static_cast<int>(a) & ~static_cast<int>(b)); }
+
+// host staging holding compressed data starts with a header of this size, through which the copies to and from it coordinate
+// the staged layout begins after it (at an offset keeping the data aligned for vector accesses), so that it is part of the layout's extent
+constexpr int64_t compressed_staging_header_size = 64;
+
+// element type conversion performed by a copy: the source layout holds elements of the first type, the target layout elements of the second
+// both layouts describe the same number of elements, so their sizes in bytes differ by the ratio of the element sizes
+enum class element_conversion : uint8_t {
+	none,
+	fp32_to_fp16,
+	fp32_to_bf16,
+	fp16_to_fp32,
+	bf16_to_fp32,
+};
+
+// size in bytes of the source and target elements of a conversion (1 without conversion, since any bytes can be copied)
+int64_t get_source_element_size(element_conversion);
+int64_t get_target_element_size(element_conversion);
+
+// conversions of the bit patterns of single elements, rounding to nearest even; usable in kernels
+constexpr uint16_t fp32_to_fp16_bits(uint32_t f) {
+	const uint32_t sign = (f >> 16) & 0x8000u;
+	const uint32_t abs = f & 0x7fffffffu;
+	if(abs > 0x7f800000u) { return sign | 0x7e00u; }     // nan, quieted
+	if(abs >= 0x477ff000u) { return sign | 0x7c00u; }    // inf, or rounds up beyond the largest fp16 value
+	if(abs >= 0x38800000u) {                             // normal fp16: rebias the exponent, a carry from rounding the mantissa increments it
+		return sign | ((abs + 0xfffu + ((abs >> 13) & 1u) - 0x38000000u) >> 13);
+	}
+	if(abs <= 0x33000000u) { return sign; }              // at most half the smallest fp16 subnormal
+	const uint32_t mantissa = (abs & 0x7fffffu) | 0x800000u;
+	const uint32_t shift = 126 - (abs >> 23);
+	const uint32_t remainder = mantissa & ((1u << shift) - 1);
+	const uint32_t halfway = 1u << (shift - 1);
+	const uint32_t truncated = mantissa >> shift;
+	return sign | (truncated + (remainder > halfway || (remainder == halfway && (truncated & 1u)) ? 1u : 0u));
+}
+
+constexpr uint32_t fp16_to_fp32_bits(uint16_t h) {
+	const uint32_t sign = (h & 0x8000u) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1fu;
+	uint32_t mantissa = h & 0x3ffu;
+	if(exponent == 0x1f) { return sign | 0x7f800000u | (mantissa << 13); }
+	if(exponent != 0) { return sign | ((exponent + 112) << 23) | (mantissa << 13); }
+	if(mantissa == 0) { return sign; }
+	// subnormal fp16 values are normal in fp32
+	uint32_t normalized_exponent = 113;
+	while((mantissa & 0x400u) == 0) {
+		mantissa <<= 1;
+		normalized_exponent--;
+	}
+	return sign | (normalized_exponent << 23) | ((mantissa & 0x3ffu) << 13);
+}
+
+constexpr uint16_t fp32_to_bf16_bits(uint32_t f) {
+	if((f & 0x7fffffffu) > 0x7f800000u) { return static_cast<uint16_t>((f >> 16) | 0x40u); } // nan, quieted
+	return static_cast<uint16_t>((f + 0x7fffu + ((f >> 16) & 1u)) >> 16);
+}
+
+constexpr uint32_t bf16_to_fp32_bits(uint16_t b) { return uint32_t{b} << 16; }
 
 // a copy specification describes a single copy operation from a source data layout and device to a destination data layout and device
 struct copy_spec {
@@ -103,14 +177,20 @@ struct copy_spec {
 	data_layout target_layout;
 
 	copy_properties properties = copy_properties::none;
+	element_conversion conversion = element_conversion::none;
 
 	constexpr copy_spec(device_id src_dev, const data_layout& src_layout, device_id tgt_dev, const data_layout& tgt_layout)
 	    : source_device(src_dev), source_layout(src_layout), target_device(tgt_dev), target_layout(tgt_layout) {}
 	constexpr copy_spec(device_id src_dev, const data_layout& src_layout, device_id tgt_dev, const data_layout& tgt_layout, copy_properties p)
 	    : source_device(src_dev), source_layout(src_layout), target_device(tgt_dev), target_layout(tgt_layout), properties(p) {}
+	constexpr copy_spec(
+	    device_id src_dev, const data_layout& src_layout, device_id tgt_dev, const data_layout& tgt_layout, copy_properties p, element_conversion c)
+	    : source_device(src_dev), source_layout(src_layout), target_device(tgt_dev), target_layout(tgt_layout), properties(p), conversion(c) {}
 
 	[[nodiscard]] constexpr bool is_contiguous() const { return source_layout.unit_stride() && target_layout.unit_stride(); }
-	[[nodiscard]] constexpr copy_spec with_properties(copy_properties p) const { return {source_device, source_layout, target_device, target_layout, p}; }
+	[[nodiscard]] constexpr copy_spec with_properties(copy_properties p) const {
+		return {source_device, source_layout, target_device, target_layout, p, conversion};
+	}
 
 	constexpr bool operator==(const copy_spec&) const = default;
 	constexpr bool operator!=(const copy_spec&) const = default;
@@ -206,12 +286,47 @@ copy_plan apply_staging(const copy_spec&, const copy_strategy&, const staging_bu
 parallel_copy_set apply_staging(const parallel_copy_set&, const copy_strategy&, const staging_buffer_provider&);
 
 // apply the desired d2d implementation to the given copy plan
-copy_plan apply_d2d_implementation(const copy_plan&, const d2d_implementation, const staging_buffer_provider&);
+// if compressed is set, contiguous copies staged in host memory at the source or target device transfer the data compressed (use_compression)
+copy_plan apply_d2d_implementation(const copy_plan&, const d2d_implementation, const staging_buffer_provider&, bool compressed = false);
 
 // apply the desired d2d implementation to the given parallel copy set (by applying it to each copy plan)
-parallel_copy_set apply_d2d_implementation(const parallel_copy_set&, const d2d_implementation, const staging_buffer_provider&);
+parallel_copy_set apply_d2d_implementation(const parallel_copy_set&, const d2d_implementation, const staging_buffer_provider&, bool compressed = false);
+
+// route copies between pageable host memory (as determined by is_pageable) and a device through pinned host staging of that device
+// the host side is copied (and reshaped) into staging with the same layout as the device side, so that the runtime does not stage internally
+using pageable_predicate = std::function<bool(const data_layout&)>;
+copy_plan apply_host_bouncing(const copy_plan&, const pageable_predicate& is_pageable, const staging_buffer_provider&);
+
+// apply host bouncing to each copy plan in the given parallel copy set
+parallel_copy_set apply_host_bouncing(const parallel_copy_set&, const pageable_predicate& is_pageable, const staging_buffer_provider&);
+
+// split the element conversion of the given copy spec off into a kernel copy within a device, so that the narrower element type is transferred:
+// narrowing conversions are performed while linearizing the source on its device, widening ones while unstaging into the target on its device
+// (in both cases on the other side if that is the host); returns the conversion and the remaining copy through device staging, in order
+copy_plan apply_element_conversion(const copy_spec&, const staging_buffer_provider&);
+
+// whether a copy within a device is performed by a kernel directly between its (differently fragmented) layouts, rather than by linearizing it:
+// this is the case if the strategy uses kernels, and the fragments of one layout are a multiple of the other's (or one of them is contiguous)
+bool is_direct_kernel_copy(const copy_spec&, const copy_strategy&);
 
 // manifests the copy strategy on the given copy spec, applying chunking and staging as necessary
+// copies within a device are not staged if they are direct kernel copies; element conversions are split off by apply_element_conversion
 parallel_copy_set manifest_strategy(const copy_spec&, const copy_strategy&, const staging_buffer_provider&);
 
+// estimated cost of executing a copy plan, in bytes moved plus byte-equivalent overheads for each step (hop) and each individual copy operation
+int64_t estimate_cost(const copy_plan&);
+
+// an assignment of the plans of a copy set to a number of parts (e.g. the queues of a device)
+struct plan_partition {
+	std::vector<std::vector<size_t>> parts; // indices of the plans in each part
+	std::vector<int64_t> costs;             // estimated cost of each part
+
+	// ratio of the most expensive part to the average part cost; 1.0 means perfectly balanced
+	double imbalance() const;
+};
+
+// distribute the plans of a copy set across parts by estimated cost, using the longest-processing-time-first heuristic
+// within each part, plans are ordered by descending cost
+plan_partition partition_by_cost(const parallel_copy_set&, int64_t parts_count);
+
 } // namespace copylib
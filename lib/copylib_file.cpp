@@ -0,0 +1,181 @@
+#include "copylib_file.hpp"
+
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace copylib {
+
+mapped_file::mapped_file(executor& exec, const std::string& path) : exec(exec), path(path) {
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	COPYLIB_ENSURE(fd >= 0, "Could not open {}: {}", path, std::strerror(errno));
+	struct stat st{};
+	const bool stat_ok = fstat(fd, &st) == 0;
+	const auto stat_errno = errno;
+	if(!stat_ok) { close(fd); }
+	COPYLIB_ENSURE(stat_ok, "Could not stat {}: {}", path, std::strerror(stat_errno));
+	file_size = st.st_size;
+	if(file_size == 0) {
+		close(fd);
+		return;
+	}
+	void* ptr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const auto mmap_errno = errno;
+	close(fd); // the mapping keeps the file open
+	COPYLIB_ENSURE(ptr != MAP_FAILED, "Could not map {}: {}", path, std::strerror(mmap_errno));
+	mapping = static_cast<std::byte*>(ptr);
+	// copies stream through the file, so let the kernel read ahead aggressively and drop pages behind
+	madvise(mapping, file_size, MADV_SEQUENTIAL);
+	exec.register_buffer(mapping, file_size, device_id::host, memory_kind::host_pageable);
+}
+
+mapped_file::~mapped_file() {
+	if(mapping == nullptr) { return; }
+	exec.unregister_buffer(mapping);
+	munmap(mapping, file_size);
+}
+
+data_layout mapped_file::get_layout(int64_t file_offset, int64_t length) const {
+	COPYLIB_ENSURE(file_offset >= 0 && length > 0 && file_offset + length <= file_size, "Range [{}, {}) is not within {} ({} bytes)", file_offset,
+	    file_offset + length, path, file_size);
+	return {reinterpret_cast<intptr_t>(mapping), file_offset, length};
+}
+
+void mapped_file::prefetch(int64_t file_offset, int64_t length) const {
+	if(mapping == nullptr) { return; }
+	static const int64_t page_size = sysconf(_SC_PAGESIZE);
+	const auto begin = std::max<int64_t>(file_offset, 0) / page_size * page_size;
+	const auto end = std::min(file_offset + length, file_size);
+	if(end <= begin) { return; }
+	// only a hint, failures are of no consequence
+	madvise(mapping + begin, end - begin, MADV_WILLNEED);
+}
+
+namespace {
+	// file offsets, sizes and buffers of writes bypassing the page cache must be aligned to the logical block size, which is at most this
+	constexpr int64_t direct_io_alignment = 4096;
+
+	// (un)staging from/to a strided layout happens on the device, and is done by kernels rather than a copy per fragment
+	// transfers between host and device remain with the copy engines
+	void use_kernels_on_device(parallel_copy_set& set, device_id did) {
+		for(auto& plan : set) {
+			for(auto& step : plan) {
+				if(step.source_device == did && step.target_device == did) { step.properties = copy_properties::use_kernel; }
+			}
+		}
+	}
+
+	// the size of the chunks a layout is linearized in, such that every chunk but the last ends on an alignment boundary of the linear stream
+	// chunks consist of whole fragments, so for strided layouts this is the closest suitable multiple of the fragment length
+	int64_t get_aligned_chunk_size(const data_layout& layout, int64_t chunk_size, int64_t alignment) {
+		if(layout.unit_stride()) { return std::max(chunk_size / alignment, int64_t{1}) * alignment; }
+		const auto fragments_per_alignment = alignment / std::gcd(layout.fragment_length, alignment);
+		const auto fragments_per_chunk = std::max(chunk_size / layout.fragment_length / fragments_per_alignment, int64_t{1}) * fragments_per_alignment;
+		return fragments_per_chunk * layout.fragment_length;
+	}
+
+	void write_fully(int fd, const std::byte* data, int64_t length, int64_t file_offset, const std::string& path) {
+		while(length > 0) {
+			const auto written = pwrite(fd, data, length, file_offset);
+			if(written < 0 && errno == EINTR) { continue; }
+			COPYLIB_ENSURE(written > 0, "Could not write {} bytes at offset {} of {}: {}", length, file_offset, path, std::strerror(errno));
+			data += written;
+			length -= written;
+			file_offset += written;
+		}
+	}
+} // namespace
+
+void copy_file_to_device(executor& exec, const std::string& path, int64_t file_offset, device_id did, const data_layout& target, int64_t chunk_size,
+    int64_t staging_slots) {
+	COPYLIB_ENSURE(did != device_id::host, "Files can only be streamed to devices, use a host copy from a mapped_file instead");
+	COPYLIB_ENSURE(chunk_size > 0, "Invalid chunk size for streaming from a file: {}", chunk_size);
+	const mapped_file file(exec, path);
+	const copy_spec spec{device_id::host, file.get_layout(file_offset, target.total_bytes()), did, target};
+
+	// the mapping is pageable, so each chunk is read into pinned staging by the host engine (faulting it in from disk) before it is transferred
+	auto set = manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::none, chunk_size}, basic_staging_provider{});
+	use_kernels_on_device(set, did);
+	// get the disk busy on the chunks in flight right away, the kernel's readahead takes it from there
+	file.prefetch(file_offset, chunk_size * staging_slots);
+	execute_copy_pipelined(exec, set, staging_slots);
+}
+
+void copy_device_to_file(executor& exec, device_id did, const data_layout& source, const std::string& path, int64_t file_offset, int64_t chunk_size,
+    int64_t ring_slots) {
+	COPYLIB_ENSURE(did != device_id::host, "Only device layouts can be streamed to files, use a host copy to a mapping instead");
+	COPYLIB_ENSURE(chunk_size > 0 && ring_slots > 0, "Invalid chunk size {} or ring slot count {} for streaming to a file", chunk_size, ring_slots);
+	COPYLIB_ENSURE(file_offset >= 0, "Invalid file offset: {}", file_offset);
+
+	// for direct writes, chunks (but the last) are a multiple of the alignment, so that every chunk is written with a single large aligned write
+	// fragment lengths sharing few factors with the alignment only add up to that in chunks far larger than requested (and than the staging),
+	// in which case the chunks keep the requested size, and are written through the page cache
+	const auto aligned_chunk_size = get_aligned_chunk_size(source, chunk_size, direct_io_alignment);
+	const bool alignable = file_offset % direct_io_alignment == 0 && aligned_chunk_size <= std::max(chunk_size, direct_io_alignment);
+
+	// bypass the page cache where the file system, the offset and the layout allow it; otherwise, the written data would occupy as much host memory as
+	// the source
+	const int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	int fd = -1;
+	bool direct = false;
+#ifdef O_DIRECT
+	if(alignable) { fd = open(path.c_str(), flags | O_DIRECT, 0644); }
+	direct = fd >= 0;
+#endif
+	if(fd < 0) { fd = open(path.c_str(), flags, 0644); }
+	COPYLIB_ENSURE(fd >= 0, "Could not open {} for writing: {}", path, std::strerror(errno));
+
+	const auto ring_chunk_size = direct ? aligned_chunk_size : get_aligned_chunk_size(source, chunk_size, 1);
+	const copy_spec spec{did, source, device_id::host, data_layout{0, 0, source.total_bytes()}}; // placeholder target, replaced by the ring slots
+	auto set = manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::none, ring_chunk_size}, basic_staging_provider{});
+	use_kernels_on_device(set, did);
+
+	// the ring is carved from the pinned host staging buffer of the device, with extra space to align the slots
+	auto& pool = exec.get_staging_pool();
+	const auto ring = pool.acquire(std::vector<staging_request>(ring_slots, {.did = did, .on_host = true, .size = ring_chunk_size + direct_io_alignment}));
+	const auto slot_buffer = [&](size_t i) {
+		const auto ptr = reinterpret_cast<intptr_t>(ring[i % ring.size()].ptr);
+		return reinterpret_cast<std::byte*>((ptr + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment);
+	};
+
+	// chunk i is transferred into slot i % ring_slots, which is refilled once it has been written
+	std::vector<copy_handle> transfers(set.size());
+	const auto start_transfer = [&](size_t i) {
+		auto& plan = set[i];
+		plan.back().target_layout = data_layout{reinterpret_cast<intptr_t>(slot_buffer(i)), 0, plan.back().target_layout.total_bytes()};
+		transfers[i] = execute_copy_async(exec, {plan});
+	};
+	for(size_t i = 0; i < std::min(set.size(), ring.size()); i++) {
+		start_transfer(i);
+	}
+	int64_t written_bytes = 0;
+	for(size_t i = 0; i < set.size(); i++) {
+		transfers[i].wait();
+		const auto length = set[i].back().target_layout.total_bytes();
+#ifdef O_DIRECT
+		if(direct && length % direct_io_alignment != 0) {
+			// the unaligned tail is written through the page cache
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			direct = false;
+		}
+#endif
+		write_fully(fd, slot_buffer(i), length, file_offset + written_bytes, path);
+		written_bytes += length;
+		if(i + ring.size() < set.size()) { start_transfer(i + ring.size()); }
+	}
+	pool.release(ring);
+	// an existing file may have extended past the written range, which is not left behind
+	const bool truncated = ftruncate(fd, file_offset + written_bytes) == 0;
+	const auto truncate_errno = errno;
+	close(fd);
+	COPYLIB_ENSURE(truncated, "Could not truncate {} to {} bytes: {}", path, file_offset + written_bytes, std::strerror(truncate_errno));
+}
+
+} // namespace copylib
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "copylib_backend.hpp"
+
+#include <string>
+
+namespace copylib {
+
+// a read-only memory mapping of a file, registered with the executor as pageable host memory for as long as it exists
+class mapped_file {
+  public:
+	mapped_file(executor& exec, const std::string& path);
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	const std::byte* data() const { return mapping; }
+	int64_t size() const { return file_size; }
+
+	// layout of the given range of the file in the mapping, for use as the source of a host copy
+	data_layout get_layout(int64_t file_offset, int64_t length) const;
+
+	// hint the kernel to start reading the given range from disk
+	void prefetch(int64_t file_offset, int64_t length) const;
+
+  private:
+	executor& exec;
+	std::string path;
+	std::byte* mapping = nullptr;
+	int64_t file_size = 0;
+};
+
+// load the (possibly strided) target layout on device `did` from the linearized bytes starting at `file_offset` in the file at `path`
+// the file is memory-mapped and streamed in chunks of at most `chunk_size` bytes: reading chunk i + 1 from disk into pinned staging,
+// transferring chunk i and unstaging chunk i - 1 into the target layout with a kernel overlap; staging is reused across `staging_slots` chunks
+void copy_file_to_device(executor& exec, const std::string& path, int64_t file_offset, device_id did, const data_layout& target, int64_t chunk_size,
+    int64_t staging_slots = 2);
+
+// write the (possibly strided) source layout on device `did` linearized to the file at `path`, starting at `file_offset` (the file is created if needed,
+// and ends after the written data)
+// chunks of about `chunk_size` bytes are linearized on the device and transferred into a ring of `ring_slots` pinned host staging slots, from which they are
+// written while the next chunks are transferred, so host memory use is bounded by the ring; writes bypass the page cache (O_DIRECT) where possible
+void copy_device_to_file(executor& exec, device_id did, const data_layout& source, const std::string& path, int64_t file_offset, int64_t chunk_size,
+    int64_t ring_slots = 2);
+
+} // namespace copylib
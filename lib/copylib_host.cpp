@@ -0,0 +1,540 @@
+#include "copylib_host.hpp"
+
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// the AVX2/AVX-512 pack routines are compiled for their target regardless of the baseline flags, and only selected at runtime
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COPYLIB_HOST_X86_SIMD 1
+#else
+#define COPYLIB_HOST_X86_SIMD 0
+#endif
+
+namespace copylib {
+
+namespace {
+	void pin_current_thread(const std::vector<int>& cpus) {
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		for(const auto cpu : cpus) {
+			CPU_SET(cpu, &mask);
+		}
+		// failure to pin is not fatal, it only affects performance
+		pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+	}
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+	std::vector<int> cpus;
+	for(const auto& range : utils::split(list, ',')) {
+		if(range.empty() || range == "\n") { continue; }
+		const auto bounds = utils::split(range, '-');
+		const int first = std::stoi(bounds[0]);
+		const int last = bounds.size() > 1 ? std::stoi(bounds[1]) : first;
+		for(int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+	std::string ret;
+	for(size_t i = 0; i < cpus.size();) {
+		size_t last = i;
+		while(last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+			last++;
+		}
+		if(!ret.empty()) { ret += ","; }
+		ret += last == i ? utils::format("{}", cpus[i]) : utils::format("{}-{}", cpus[i], cpus[last]);
+		i = last + 1;
+	}
+	return ret;
+}
+
+std::vector<std::vector<int>> get_numa_node_cpus() {
+	std::vector<std::vector<int>> nodes;
+	const std::filesystem::path node_dir = "/sys/devices/system/node";
+	std::error_code ec;
+	for(int node = 0; std::filesystem::exists(node_dir / utils::format("node{}", node), ec); node++) {
+		std::ifstream cpulist(node_dir / utils::format("node{}", node) / "cpulist");
+		std::string list;
+		std::getline(cpulist, list);
+		nodes.push_back(parse_cpu_list(list));
+	}
+	// nodes without CPUs (e.g. pure memory nodes) are reported with an empty list
+	if(std::ranges::all_of(nodes, [](const auto& cpus) { return cpus.empty(); })) {
+		std::vector<int> all_cpus(std::max(1u, std::thread::hardware_concurrency()));
+		std::iota(all_cpus.begin(), all_cpus.end(), 0);
+		return {all_cpus};
+	}
+	return nodes;
+}
+
+int get_numa_node_of(const void* ptr) {
+#if defined(SYS_get_mempolicy)
+	constexpr unsigned long mpol_f_node = 1 << 0;
+	constexpr unsigned long mpol_f_addr = 1 << 1;
+	int node = -1;
+	if(syscall(SYS_get_mempolicy, &node, nullptr, 0, const_cast<void*>(ptr), mpol_f_node | mpol_f_addr) == 0) { return node; }
+#endif
+	(void)ptr;
+	return -1;
+}
+
+int get_numa_node_of_cpu(int cpu) {
+	const auto nodes = get_numa_node_cpus();
+	for(size_t node = 0; node < nodes.size(); node++) {
+		if(std::ranges::find(nodes[node], cpu) != nodes[node].end()) { return static_cast<int>(node); }
+	}
+	return -1;
+}
+
+pci_device_locality get_pci_device_locality(const std::string& pci_address) {
+	pci_device_locality locality;
+	if(pci_address.empty()) { return locality; }
+	// sysfs uses lower case hex digits, while e.g. CUDA reports upper case ones
+	std::string address = pci_address;
+	std::ranges::transform(address, address.begin(), [](unsigned char c) { return std::tolower(c); });
+	const auto device_dir = std::filesystem::path("/sys/bus/pci/devices") / address;
+	std::error_code ec;
+	if(!std::filesystem::exists(device_dir, ec)) { return locality; }
+	locality.pci_address = address;
+	std::ifstream numa_node_file(device_dir / "numa_node");
+	if(!(numa_node_file >> locality.numa_node)) { locality.numa_node = -1; }
+	std::ifstream cpulist(device_dir / "local_cpulist");
+	std::string list;
+	if(std::getline(cpulist, list)) { locality.local_cpus = parse_cpu_list(list); }
+	return locality;
+}
+
+namespace {
+	std::pair<uintptr_t, uintptr_t> page_range(const void* ptr, int64_t size) {
+		const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+		const auto start = reinterpret_cast<uintptr_t>(ptr) / page_size * page_size;
+		const auto end = (reinterpret_cast<uintptr_t>(ptr) + size + page_size - 1) / page_size * page_size;
+		return {start, end};
+	}
+} // namespace
+
+bool bind_to_numa_node(void* ptr, int64_t size, int numa_node) {
+#if defined(SYS_mbind)
+	if(numa_node < 0 || size <= 0) { return false; }
+	constexpr int mpol_bind = 2;
+	constexpr unsigned mpol_mf_move = 1 << 1;
+	constexpr size_t bits_per_mask_word = 8 * sizeof(unsigned long);
+	std::vector<unsigned long> node_mask(numa_node / bits_per_mask_word + 1, 0);
+	node_mask[numa_node / bits_per_mask_word] |= 1ul << (numa_node % bits_per_mask_word);
+	const auto [start, end] = page_range(ptr, size);
+	// the kernel expects the number of mask bits plus one
+	return syscall(SYS_mbind, start, end - start, mpol_bind, node_mask.data(), node_mask.size() * bits_per_mask_word + 1, mpol_mf_move) == 0;
+#else
+	(void)ptr, (void)size, (void)numa_node;
+	return false;
+#endif
+}
+
+double get_fraction_on_numa_node(const void* ptr, int64_t size, int numa_node, int64_t max_samples) {
+#if defined(SYS_move_pages)
+	if(size <= 0 || max_samples <= 0) { return 0; }
+	const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	const auto [start, end] = page_range(ptr, size);
+	const auto page_count = static_cast<int64_t>((end - start) / page_size);
+	const auto samples = std::min(page_count, max_samples);
+	std::vector<void*> pages(samples);
+	for(int64_t i = 0; i < samples; i++) {
+		pages[i] = reinterpret_cast<void*>(start + (page_count * i / samples) * page_size);
+	}
+	// without target nodes, move_pages only reports the node of each page (or a negative error code if it is not placed)
+	std::vector<int> status(samples, -1);
+	if(syscall(SYS_move_pages, 0, samples, pages.data(), nullptr, status.data(), 0) != 0) { return 0; }
+	return static_cast<double>(std::ranges::count(status, numa_node)) / static_cast<double>(samples);
+#else
+	(void)ptr, (void)size, (void)numa_node, (void)max_samples;
+	return 0;
+#endif
+}
+
+void memcpy_non_temporal(std::byte* tgt, const std::byte* src, int64_t length) {
+#if defined(__SSE2__)
+	// peel until the target is aligned for streaming stores
+	const int64_t head = std::min(length, static_cast<int64_t>((16 - reinterpret_cast<uintptr_t>(tgt) % 16) % 16));
+	std::memcpy(tgt, src, head);
+	int64_t i = head;
+	for(; i + 64 <= length; i += 64) {
+		const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+		const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32));
+		const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(tgt + i), a);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(tgt + i + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(tgt + i + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(tgt + i + 48), d);
+	}
+	std::memcpy(tgt + i, src + i, length - i);
+#else
+	std::memcpy(tgt, src, length);
+#endif
+}
+
+void non_temporal_fence() {
+#if defined(__SSE2__)
+	_mm_sfence();
+#endif
+}
+
+namespace {
+	// with the fragment length known at compile time, each fragment is a single load and store
+	template <int64_t Length>
+	void pack_fixed(std::byte* tgt, const std::byte* src, int64_t stride, int64_t count) {
+		for(int64_t i = 0; i < count; i++) {
+			std::memcpy(tgt + i * Length, src + i * stride, Length);
+		}
+	}
+
+	template <int64_t Length>
+	void unpack_fixed(std::byte* tgt, const std::byte* src, int64_t stride, int64_t count) {
+		for(int64_t i = 0; i < count; i++) {
+			std::memcpy(tgt + i * stride, src + i * Length, Length);
+		}
+	}
+
+	void pack_scalar(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count) {
+		switch(fragment_length) {
+		case 1: return pack_fixed<1>(tgt, src, stride, count);
+		case 2: return pack_fixed<2>(tgt, src, stride, count);
+		case 4: return pack_fixed<4>(tgt, src, stride, count);
+		case 8: return pack_fixed<8>(tgt, src, stride, count);
+		case 16: return pack_fixed<16>(tgt, src, stride, count);
+		case 32: return pack_fixed<32>(tgt, src, stride, count);
+		default:
+			for(int64_t i = 0; i < count; i++) {
+				std::memcpy(tgt + i * fragment_length, src + i * stride, fragment_length);
+			}
+		}
+	}
+
+	void unpack_scalar(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count) {
+		switch(fragment_length) {
+		case 1: return unpack_fixed<1>(tgt, src, stride, count);
+		case 2: return unpack_fixed<2>(tgt, src, stride, count);
+		case 4: return unpack_fixed<4>(tgt, src, stride, count);
+		case 8: return unpack_fixed<8>(tgt, src, stride, count);
+		case 16: return unpack_fixed<16>(tgt, src, stride, count);
+		case 32: return unpack_fixed<32>(tgt, src, stride, count);
+		default:
+			for(int64_t i = 0; i < count; i++) {
+				std::memcpy(tgt + i * stride, src + i * fragment_length, fragment_length);
+			}
+		}
+	}
+
+#if COPYLIB_HOST_X86_SIMD
+	// the gather/scatter indices are 32 bit byte offsets relative to the first fragment of each vector
+	bool fits_gather_index(int64_t stride, int64_t lanes) { return stride * (lanes - 1) <= std::numeric_limits<int32_t>::max(); }
+
+	// AVX2 has gathers but no scatters, so only packing is vectorized
+	// returns the number of fragments processed, the remainder is left to the scalar version
+	__attribute__((target("avx2"))) int64_t pack_avx2(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count) {
+		if(fragment_length == 4 && fits_gather_index(stride, 8)) {
+			const auto s = static_cast<int32_t>(stride);
+			const auto idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+			int64_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				const auto v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src + i * stride), idx, 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(tgt + i * 4), v);
+			}
+			return i;
+		}
+		if(fragment_length == 8 && fits_gather_index(stride, 4)) {
+			const auto s = static_cast<int32_t>(stride);
+			const auto idx = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+			int64_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				const auto v = _mm256_i32gather_epi64(reinterpret_cast<const long long*>(src + i * stride), idx, 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(tgt + i * 8), v);
+			}
+			return i;
+		}
+		if(fragment_length == 16) {
+			int64_t i = 0;
+			for(; i + 2 <= count; i += 2) {
+				const auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * stride));
+				const auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (i + 1) * stride));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(tgt + i * 16), _mm256_set_m128i(hi, lo));
+			}
+			return i;
+		}
+		return 0;
+	}
+
+	__attribute__((target("avx512f"))) int64_t pack_avx512(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count) {
+		if(fragment_length == 4 && fits_gather_index(stride, 16)) {
+			const auto idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(static_cast<int32_t>(stride)));
+			int64_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				const auto v = _mm512_i32gather_epi32(idx, src + i * stride, 1);
+				_mm512_storeu_si512(tgt + i * 4, v);
+			}
+			return i;
+		}
+		if(fragment_length == 8 && fits_gather_index(stride, 8)) {
+			const auto s = static_cast<int32_t>(stride);
+			const auto idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+			int64_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				const auto v = _mm512_i32gather_epi64(idx, src + i * stride, 1);
+				_mm512_storeu_si512(tgt + i * 8, v);
+			}
+			return i;
+		}
+		return pack_avx2(tgt, src, fragment_length, stride, count);
+	}
+
+	__attribute__((target("avx512f"))) int64_t unpack_avx512(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count) {
+		if(fragment_length == 4 && fits_gather_index(stride, 16)) {
+			const auto idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(static_cast<int32_t>(stride)));
+			int64_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				_mm512_i32scatter_epi32(tgt + i * stride, idx, _mm512_loadu_si512(src + i * 4), 1);
+			}
+			return i;
+		}
+		if(fragment_length == 8 && fits_gather_index(stride, 8)) {
+			const auto s = static_cast<int32_t>(stride);
+			const auto idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+			int64_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				_mm512_i32scatter_epi64(tgt + i * stride, idx, _mm512_loadu_si512(src + i * 8), 1);
+			}
+			return i;
+		}
+		return 0;
+	}
+#endif // COPYLIB_HOST_X86_SIMD
+} // namespace
+
+host_simd_level get_host_simd_level() {
+	static const host_simd_level level = [] {
+#if COPYLIB_HOST_X86_SIMD
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")) { return host_simd_level::avx512; }
+		if(__builtin_cpu_supports("avx2")) { return host_simd_level::avx2; }
+#endif
+		return host_simd_level::scalar;
+	}();
+	return level;
+}
+
+const char* get_host_simd_level_name(host_simd_level level) {
+	switch(level) {
+	case host_simd_level::scalar: return "scalar";
+	case host_simd_level::avx2: return "AVX2";
+	case host_simd_level::avx512: return "AVX-512";
+	}
+	return "unknown";
+}
+
+void pack_fragments(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count, host_simd_level level) {
+	COPYLIB_ENSURE(level <= get_host_simd_level(), "SIMD level {} is not supported on this CPU", get_host_simd_level_name(level));
+	int64_t done = 0;
+#if COPYLIB_HOST_X86_SIMD
+	if(level == host_simd_level::avx512) {
+		done = pack_avx512(tgt, src, fragment_length, stride, count);
+	} else if(level == host_simd_level::avx2) {
+		done = pack_avx2(tgt, src, fragment_length, stride, count);
+	}
+#endif
+	pack_scalar(tgt + done * fragment_length, src + done * stride, fragment_length, stride, count - done);
+}
+
+void unpack_fragments(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count, host_simd_level level) {
+	COPYLIB_ENSURE(level <= get_host_simd_level(), "SIMD level {} is not supported on this CPU", get_host_simd_level_name(level));
+	int64_t done = 0;
+#if COPYLIB_HOST_X86_SIMD
+	if(level == host_simd_level::avx512) { done = unpack_avx512(tgt, src, fragment_length, stride, count); }
+#endif
+	unpack_scalar(tgt + done * stride, src + done * fragment_length, fragment_length, stride, count - done);
+}
+
+host_copy_engine::host_copy_engine(int64_t num_threads) {
+	if(num_threads <= 0) {
+		const auto env_str = std::getenv("COPYLIB_HOST_COPY_THREADS");
+		num_threads = env_str ? std::stoll(env_str) : std::clamp<int64_t>(std::thread::hardware_concurrency() / 2, 1, 16);
+	}
+	COPYLIB_ENSURE(num_threads > 0, "Need at least one host copy thread, got {}", num_threads);
+	const auto nodes = get_numa_node_cpus();
+	const auto nodes_with_cpus = static_cast<int64_t>(std::ranges::count_if(nodes, [](const auto& cpus) { return !cpus.empty(); }));
+	int64_t cpu_node_idx = 0;
+	for(const auto& cpus : nodes) {
+		if(cpus.empty()) {
+			node_pools.push_back(nullptr);
+			continue;
+		}
+		const auto threads_for_node = std::max<int64_t>(1, num_threads / nodes_with_cpus + (cpu_node_idx++ < num_threads % nodes_with_cpus ? 1 : 0));
+		node_pools.push_back(std::make_unique<BS::thread_pool<>>(threads_for_node, [cpus] { pin_current_thread(cpus); }));
+		thread_count += threads_for_node;
+	}
+}
+
+host_copy_engine::~host_copy_engine() = default;
+
+void host_copy_engine::copy(const copy_spec& spec) {
+	COPYLIB_ENSURE(spec.source_device == device_id::host && spec.target_device == device_id::host, "Not a host to host copy: {}", spec);
+	COPYLIB_ENSURE(spec.conversion == element_conversion::none, "Host copies cannot convert elements: {}", spec);
+	const auto total_bytes = spec.source_layout.total_bytes();
+	// streaming only pays off for long contiguous runs, the fragments of a large strided copy are usually too short
+	const bool non_temporal = total_bytes >= non_temporal_threshold;
+	const auto copy_fun = [non_temporal](const std::byte* src, std::byte* tgt, int64_t length) {
+		if(non_temporal && length >= min_non_temporal_run_length) {
+			memcpy_non_temporal(tgt, src, length);
+		} else {
+			std::memcpy(tgt, src, length);
+		}
+	};
+
+	// if one side is contiguous and the other consists of small fragments, gather or scatter them in bulk rather than one memcpy per fragment
+	const auto& src_layout = spec.source_layout;
+	const auto& tgt_layout = spec.target_layout;
+	const bool packed = src_layout.unit_stride() != tgt_layout.unit_stride()
+	                    && (src_layout.unit_stride() ? tgt_layout : src_layout).fragment_length <= max_packed_fragment_length;
+	const auto pack_or_unpack = [&src_layout, &tgt_layout](int64_t first, int64_t last) {
+		if(tgt_layout.unit_stride()) {
+			pack_fragments(tgt_layout.base_ptr() + tgt_layout.offset + first * src_layout.fragment_length, src_layout.base_ptr() + src_layout.fragment_offset(first),
+			    src_layout.fragment_length, src_layout.effective_stride(), last - first);
+		} else {
+			unpack_fragments(tgt_layout.base_ptr() + tgt_layout.fragment_offset(first), src_layout.base_ptr() + src_layout.offset + first * tgt_layout.fragment_length,
+			    tgt_layout.fragment_length, tgt_layout.effective_stride(), last - first);
+		}
+	};
+
+	const int64_t max_blocks = std::min(thread_count, total_bytes / min_bytes_per_block);
+	if(total_bytes < parallel_threshold || max_blocks < 2) {
+		if(packed) {
+			pack_or_unpack(0, (src_layout.unit_stride() ? tgt_layout : src_layout).fragment_count);
+		} else {
+			copy_via_repeated_1D_copies(copy_fun, src_layout, tgt_layout);
+		}
+		if(non_temporal) { non_temporal_fence(); }
+		return;
+	}
+
+	// split the work between the pools of the source and target NUMA nodes (or all of them, if the placement is not known)
+	std::vector<BS::thread_pool<>*> pools;
+	for(const auto node : {get_numa_node_of(spec.source_layout.base_ptr() + spec.source_layout.offset),
+	        get_numa_node_of(spec.target_layout.base_ptr() + spec.target_layout.offset)}) {
+		if(node >= 0 && node < get_numa_node_count() && node_pools[node] && std::ranges::find(pools, node_pools[node].get()) == pools.end()) {
+			pools.push_back(node_pools[node].get());
+		}
+	}
+	if(pools.empty()) {
+		for(auto& pool : node_pools) {
+			if(pool) { pools.push_back(pool.get()); }
+		}
+	}
+	int64_t pool_threads = 0;
+	for(const auto pool : pools) {
+		pool_threads += pool->get_thread_count();
+	}
+	const int64_t num_blocks = std::min(max_blocks, pool_threads);
+
+	std::vector<std::future<void>> futures;
+	futures.reserve(num_blocks);
+	// streaming stores are weakly ordered, so each worker makes those of its block visible before signaling completion
+	const auto submit_block = [&](int64_t block, auto fun) {
+		futures.push_back(pools[block % pools.size()]->submit_task([fun = std::move(fun), non_temporal] {
+			fun();
+			if(non_temporal) { non_temporal_fence(); }
+		}));
+	};
+	const auto num_copies = packed ? (src_layout.unit_stride() ? tgt_layout : src_layout).fragment_count : std::max(src_layout.fragment_count, tgt_layout.fragment_count);
+	if(num_copies == 1) {
+		// a single contiguous copy, split by bytes (at cache line granularity)
+		const auto src = spec.source_layout.base_ptr() + spec.source_layout.offset;
+		const auto tgt = spec.target_layout.base_ptr() + spec.target_layout.offset;
+		const auto bytes_per_block = ((total_bytes + num_blocks - 1) / num_blocks + 63) / 64 * 64;
+		for(int64_t block = 0; block < num_blocks; block++) {
+			const auto start = std::min(total_bytes, block * bytes_per_block);
+			const auto length = std::min(total_bytes, start + bytes_per_block) - start;
+			if(length > 0) {
+				submit_block(block, [=] { copy_fun(src + start, tgt + start, length); });
+			}
+		}
+	} else if(packed) {
+		// split by fragments of the strided side, which are gathered from or scattered to the contiguous side in one go
+		for(int64_t block = 0; block < num_blocks; block++) {
+			const auto first = num_copies * block / num_blocks;
+			const auto last = num_copies * (block + 1) / num_blocks;
+			submit_block(block, [=] { pack_or_unpack(first, last); });
+		}
+	} else {
+		// split by fragments
+		for(int64_t block = 0; block < num_blocks; block++) {
+			const auto first = num_copies * block / num_blocks;
+			const auto last = num_copies * (block + 1) / num_blocks;
+			submit_block(block, [=] { copy_via_repeated_1D_copies(copy_fun, spec.source_layout, spec.target_layout, first, last); });
+		}
+	}
+	for(auto& f : futures) {
+		f.get();
+	}
+}
+
+void host_copy_engine::initialize(std::byte* buffer, int64_t size, buffer_init init, int numa_node) {
+	if(init == buffer_init::none || size <= 0) { return; }
+	std::vector<BS::thread_pool<>*> pools;
+	if(numa_node >= 0 && numa_node < get_numa_node_count() && node_pools[numa_node]) {
+		pools.push_back(node_pools[numa_node].get());
+	} else {
+		for(auto& pool : node_pools) {
+			if(pool) { pools.push_back(pool.get()); }
+		}
+	}
+
+	// blocks start at multiples of the pattern length, so that each can be filled from the same template
+	constexpr int64_t pattern_length = 256;
+	std::array<std::byte, pattern_length> pattern;
+	for(int64_t i = 0; i < pattern_length; i++) {
+		pattern[i] = static_cast<std::byte>(i);
+	}
+	const auto fill_block = [=, &pattern](int64_t start, int64_t end) {
+		if(init == buffer_init::first_touch) {
+			std::memset(buffer + start, 0, end - start);
+			return;
+		}
+		for(int64_t i = start; i < end; i += pattern_length) {
+			std::memcpy(buffer + i, pattern.data(), std::min(pattern_length, end - i));
+		}
+	};
+
+	int64_t pool_threads = 0;
+	for(const auto pool : pools) {
+		pool_threads += pool->get_thread_count();
+	}
+	const int64_t num_blocks = std::max<int64_t>(1, std::min(pool_threads, size / min_bytes_per_block));
+	const auto bytes_per_block = ((size + num_blocks - 1) / num_blocks + pattern_length - 1) / pattern_length * pattern_length;
+	std::vector<std::future<void>> futures;
+	for(int64_t block = 0; block < num_blocks; block++) {
+		const auto start = std::min(size, block * bytes_per_block);
+		const auto end = std::min(size, start + bytes_per_block);
+		if(start < end) { futures.push_back(pools[block % pools.size()]->submit_task([=] { fill_block(start, end); })); }
+	}
+	for(auto& f : futures) {
+		f.get();
+	}
+}
+
+} // namespace copylib
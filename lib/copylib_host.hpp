@@ -0,0 +1,115 @@
+#pragma once
+
+#include "copylib_core.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <bs_thread_pool/bs_thread_pool.hpp>
+
+namespace copylib {
+
+// perform the 1D copies which implement a copy between two (possibly differently fragmented) layouts, calling fun(src, tgt, length) for each
+// only the copies in [first_copy, last_copy) are performed; by default, all of them
+template <typename CopyFun>
+void copy_via_repeated_1D_copies(CopyFun fun, const data_layout& source_layout, const data_layout& target_layout, int64_t first_copy = 0, int64_t last_copy = -1) {
+	const auto larger_fragment_count = std::max(source_layout.fragment_count, target_layout.fragment_count);
+	const auto smaller_fragment_size = std::min(source_layout.fragment_length, target_layout.fragment_length);
+	if(last_copy < 0) { last_copy = larger_fragment_count; }
+	for(int64_t frag = first_copy; frag < last_copy; ++frag) {
+		const auto src_factor = source_layout.fragment_length / smaller_fragment_size;
+		const auto tgt_factor = target_layout.fragment_length / smaller_fragment_size;
+		const auto src_fragment_id = frag / src_factor;
+		const auto tgt_fragment_id = frag / tgt_factor;
+		const auto src_offset_in_fragment = frag % src_factor * target_layout.fragment_length;
+		const auto src = source_layout.base_ptr() + source_layout.fragment_offset(src_fragment_id) + src_offset_in_fragment;
+		const auto tgt_offset_in_fragment = frag % tgt_factor * source_layout.fragment_length;
+		const auto tgt = target_layout.base_ptr() + target_layout.fragment_offset(tgt_fragment_id) + tgt_offset_in_fragment;
+		fun(src, tgt, smaller_fragment_size);
+	}
+}
+
+// the CPUs of each NUMA node (empty for nodes without CPUs), as reported by sysfs; a single node with all CPUs if that information is not available
+std::vector<std::vector<int>> get_numa_node_cpus();
+
+// the NUMA node the memory at the given address resides on, or -1 if unknown (e.g. not yet touched)
+int get_numa_node_of(const void* ptr);
+// the NUMA node the given CPU belongs to, or -1 if unknown
+int get_numa_node_of_cpu(int cpu);
+
+// parse and format CPU lists in the sysfs format, e.g. "0-3,8-11"
+std::vector<int> parse_cpu_list(const std::string& list);
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// where a PCI device (such as a GPU) is attached, as reported by sysfs
+struct pci_device_locality {
+	std::string pci_address; // domain:bus:device.function, e.g. "0000:3b:00.0"; empty if unknown
+	int numa_node = -1;      // -1 if unknown, or if the platform does not report it
+	std::vector<int> local_cpus;
+};
+
+// look up the locality of the device with the given PCI address (all unknown if it can not be found)
+pci_device_locality get_pci_device_locality(const std::string& pci_address);
+
+// bind the pages of the given range to a NUMA node, moving those which already reside elsewhere; returns whether the kernel accepted the binding
+bool bind_to_numa_node(void* ptr, int64_t size, int numa_node);
+
+// the fraction of pages in the given range which reside on the given NUMA node, determined from an evenly spaced sample of at most max_samples pages
+// pages which have not been placed yet count as not residing on the node
+double get_fraction_on_numa_node(const void* ptr, int64_t size, int numa_node, int64_t max_samples = 64);
+
+// how host buffers are initialized after allocation
+enum class buffer_init {
+	none,        // not at all, the pages are placed wherever they are first written
+	first_touch, // zeroed in parallel by threads on the intended NUMA node
+	pattern,     // like first_touch, but filled with the byte pattern i % 256
+};
+
+// copy with stores that bypass the cache, for streams much larger than the cache which are not read again soon
+// the stores are weakly ordered: call non_temporal_fence once after a sequence of these copies, before signaling their completion
+void memcpy_non_temporal(std::byte* tgt, const std::byte* src, int64_t length);
+void non_temporal_fence();
+
+// instruction set extensions used to pack and unpack small strided fragments on the host
+enum class host_simd_level { scalar, avx2, avx512 };
+
+// the most capable level supported by the CPU we are running on (detected once)
+host_simd_level get_host_simd_level();
+const char* get_host_simd_level_name(host_simd_level level);
+
+// gather `count` fragments of `fragment_length` bytes which are `stride` bytes apart in src into the contiguous buffer tgt
+void pack_fragments(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count, host_simd_level level = get_host_simd_level());
+// scatter `count` fragments of `fragment_length` bytes from the contiguous buffer src to tgt, `stride` bytes apart
+void unpack_fragments(std::byte* tgt, const std::byte* src, int64_t fragment_length, int64_t stride, int64_t count, host_simd_level level = get_host_simd_level());
+
+// performs host to host copies, splitting large copies across worker threads pinned to the NUMA nodes of the source and target memory
+class host_copy_engine {
+  public:
+	static constexpr int64_t parallel_threshold = 1024 * 1024;          // smaller copies are performed by the calling thread
+	static constexpr int64_t non_temporal_threshold = 16 * 1024 * 1024; // larger copies use non-temporal stores
+	static constexpr int64_t min_non_temporal_run_length = 4096;        // but only for contiguous runs at least this long
+	static constexpr int64_t min_bytes_per_block = 256 * 1024;          // don't split copies into smaller blocks than this
+	static constexpr int64_t max_packed_fragment_length = 256;          // strided sides with smaller fragments are packed/unpacked as a whole
+
+	// num_threads <= 0 selects the COPYLIB_HOST_COPY_THREADS environment variable, or half the hardware threads by default (at most 16)
+	explicit host_copy_engine(int64_t num_threads = 0);
+	~host_copy_engine();
+
+	host_copy_engine(const host_copy_engine&) = delete;
+	host_copy_engine& operator=(const host_copy_engine&) = delete;
+
+	// perform the given host to host copy, returning once it is complete
+	void copy(const copy_spec& spec);
+	// initialize a buffer in parallel from the threads of the given NUMA node (all threads if unknown), so that its pages are placed on that node
+	void initialize(std::byte* buffer, int64_t size, buffer_init init, int numa_node);
+
+	int64_t get_thread_count() const { return thread_count; }
+	int64_t get_numa_node_count() const { return static_cast<int64_t>(node_pools.size()); }
+
+  private:
+	int64_t thread_count = 0;
+	std::vector<std::unique_ptr<BS::thread_pool<>>> node_pools; // one pool per NUMA node with CPUs, with its threads pinned to the node
+};
+
+} // namespace copylib
@@ -0,0 +1,59 @@
+#include "copylib_registry.hpp"
+
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <mutex>
+
+namespace copylib {
+
+void buffer_registry::add(const registered_buffer& buffer) {
+	COPYLIB_ENSURE(buffer.base != 0 && buffer.size > 0, "Invalid buffer registration: {:#x} ({} bytes)", buffer.base, buffer.size);
+	std::unique_lock lock(mutex);
+	// the next buffer must start after this one ends, and the previous one must end before it starts
+	const auto next = buffers.lower_bound(buffer.base);
+	COPYLIB_ENSURE(next == buffers.end() || next->first >= buffer.end(), "Buffer at {:#x} ({} bytes) overlaps the registered buffer at {:#x}", buffer.base,
+	    buffer.size, next->first);
+	if(next != buffers.begin()) {
+		const auto& prev = std::prev(next)->second;
+		COPYLIB_ENSURE(prev.end() <= buffer.base, "Buffer at {:#x} ({} bytes) overlaps the registered buffer at {:#x}", buffer.base, buffer.size, prev.base);
+	}
+	buffers.emplace_hint(next, buffer.base, buffer);
+}
+
+void buffer_registry::remove(intptr_t base) {
+	std::unique_lock lock(mutex);
+	COPYLIB_ENSURE(buffers.erase(base) == 1, "No buffer registered at {:#x}", base);
+}
+
+std::optional<registered_buffer> buffer_registry::find(intptr_t address) const {
+	std::shared_lock lock(mutex);
+	auto it = buffers.upper_bound(address);
+	if(it == buffers.begin()) { return std::nullopt; }
+	--it;
+	if(address >= it->second.end()) { return std::nullopt; }
+	return it->second;
+}
+
+size_t buffer_registry::size() const {
+	std::shared_lock lock(mutex);
+	return buffers.size();
+}
+
+std::optional<std::string> check_against_registry(const buffer_registry& registry, const copy_spec& spec) {
+	for(const auto& [did, layout] : {std::pair{spec.source_device, spec.source_layout}, std::pair{spec.target_device, spec.target_layout}}) {
+		if(layout.is_unplaced_staging() || layout.total_bytes() == 0) { continue; }
+		const auto start = layout.base + layout.offset;
+		const auto buffer = registry.find(start);
+		if(!buffer.has_value()) { continue; }
+		if(layout.base + layout.end_offset() > buffer->end()) {
+			return utils::format("Layout {} exceeds the registered buffer at {:#x} ({} bytes)", layout, buffer->base, buffer->size);
+		}
+		const bool host_memory = buffer->kind == memory_kind::host_pinned || buffer->kind == memory_kind::host_pageable;
+		if(buffer->kind != memory_kind::shared && host_memory != (did == device_id::host)) {
+			return utils::format("Layout {} is used on {}, but lies in {} memory registered for {}", layout, did, host_memory ? "host" : "device", buffer->did);
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace copylib
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "copylib_core.hpp"
+
+#include <map>
+#include <optional>
+#include <shared_mutex>
+
+namespace copylib {
+
+// the kind of memory backing a buffer, which determines how it can be accessed and which copy paths are efficient
+enum class memory_kind {
+	device,        // device memory, only accessible on its device (and peers)
+	host_pinned,   // page-locked host memory, which devices can access directly and transfer from at full bandwidth
+	host_pageable, // ordinary host memory, which the runtime has to stage through pinned memory itself
+	shared,        // shared (managed) memory, accessible everywhere
+};
+
+// a buffer known to the executor, either one of its own or one registered by the application
+struct registered_buffer {
+	intptr_t base = 0;
+	int64_t size = 0;
+	device_id did = device_id::host;
+	memory_kind kind = memory_kind::host_pageable;
+
+	intptr_t end() const { return base + size; }
+};
+
+// non-overlapping registered buffers, ordered by address so that the buffer containing a pointer can be found in logarithmic time
+// it is thread-safe; lookups from concurrently executing copies only take a shared lock
+class buffer_registry {
+  public:
+	void add(const registered_buffer& buffer);
+	// remove the buffer starting at the given address
+	void remove(intptr_t base);
+
+	// the buffer containing the given address, if any
+	std::optional<registered_buffer> find(intptr_t address) const;
+
+	// the number of registered buffers
+	size_t size() const;
+
+  private:
+	mutable std::shared_mutex mutex;
+	std::map<intptr_t, registered_buffer> buffers; // by base address
+};
+
+// whether a copy spec is compatible with the registered buffers its (placed) layouts lie in: they must be fully contained in them,
+// and device and host memory must be used from the device or host respectively; unregistered memory can not be checked and is accepted
+// returns an error message describing the first violation, if any
+std::optional<std::string> check_against_registry(const buffer_registry& registry, const copy_spec& spec);
+
+} // namespace copylib
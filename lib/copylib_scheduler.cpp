@@ -0,0 +1,101 @@
+#include "copylib_scheduler.hpp"
+
+#include "utils.hpp"
+
+namespace copylib {
+
+work_stealing_scheduler::work_stealing_scheduler(int64_t num_workers) {
+	COPYLIB_ENSURE(num_workers > 0, "Need at least one worker, got {}", num_workers);
+	workers.reserve(num_workers);
+	for(int64_t i = 0; i < num_workers; i++) {
+		workers.push_back(std::make_unique<worker>());
+	}
+	// only start threads once all workers exist, as they access each other's queues
+	for(int64_t i = 0; i < num_workers; i++) {
+		workers[i]->thread = std::thread([this, i] { work(i); });
+	}
+}
+
+work_stealing_scheduler::~work_stealing_scheduler() {
+	{
+		std::lock_guard lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_cv.notify_all();
+	for(auto& w : workers) {
+		w->thread.join();
+	}
+}
+
+void work_stealing_scheduler::submit(std::vector<std::vector<task>> tasks_per_worker) {
+	COPYLIB_ENSURE(tasks_per_worker.size() <= workers.size(), "Tasks assigned to {} workers, but only {} exist", tasks_per_worker.size(), workers.size());
+	int64_t added = 0;
+	for(size_t i = 0; i < tasks_per_worker.size(); i++) {
+		std::lock_guard lock(workers[i]->mutex);
+		for(auto& t : tasks_per_worker[i]) {
+			workers[i]->tasks.push_back(std::move(t));
+			added++;
+		}
+	}
+	{
+		std::lock_guard lock(sleep_mutex);
+		pending_tasks += added;
+	}
+	sleep_cv.notify_all();
+}
+
+void work_stealing_scheduler::submit(int64_t worker_idx, task t) {
+	COPYLIB_ENSURE(worker_idx >= 0 && worker_idx < get_worker_count(), "Invalid worker index {} ({} workers)", worker_idx, get_worker_count());
+	{
+		std::lock_guard lock(workers[worker_idx]->mutex);
+		workers[worker_idx]->tasks.push_back(std::move(t));
+	}
+	{
+		std::lock_guard lock(sleep_mutex);
+		pending_tasks++;
+	}
+	sleep_cv.notify_all();
+}
+
+bool work_stealing_scheduler::try_pop(int64_t worker_idx, task& t) {
+	auto& w = *workers[worker_idx];
+	std::lock_guard lock(w.mutex);
+	if(w.tasks.empty()) { return false; }
+	t = std::move(w.tasks.front());
+	w.tasks.pop_front();
+	return true;
+}
+
+bool work_stealing_scheduler::try_steal(int64_t worker_idx, task& t) {
+	const auto num_workers = get_worker_count();
+	for(int64_t offset = 1; offset < num_workers; offset++) {
+		auto& victim = *workers[(worker_idx + offset) % num_workers];
+		std::lock_guard lock(victim.mutex);
+		if(victim.tasks.empty()) { continue; }
+		// steal from the back, the owner works from the front
+		t = std::move(victim.tasks.back());
+		victim.tasks.pop_back();
+		steal_count++;
+		return true;
+	}
+	return false;
+}
+
+void work_stealing_scheduler::work(int64_t worker_idx) {
+	while(true) {
+		task t;
+		if(try_pop(worker_idx, t) || try_steal(worker_idx, t)) {
+			{
+				std::lock_guard lock(sleep_mutex);
+				pending_tasks--;
+			}
+			t(worker_idx);
+			continue;
+		}
+		std::unique_lock lock(sleep_mutex);
+		sleep_cv.wait(lock, [&] { return stopping || pending_tasks > 0; });
+		if(stopping && pending_tasks == 0) { return; }
+	}
+}
+
+} // namespace copylib
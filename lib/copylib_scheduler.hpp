@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace copylib {
+
+// a persistent pool of workers, each with its own task queue; workers which run out of tasks steal from the back of the queues of busy workers
+// tasks receive the index of the worker executing them, which the executor uses to select the queue to submit to
+class work_stealing_scheduler {
+  public:
+	using task = std::function<void(int64_t worker_idx)>;
+
+	explicit work_stealing_scheduler(int64_t num_workers);
+	~work_stealing_scheduler();
+
+	work_stealing_scheduler(const work_stealing_scheduler&) = delete;
+	work_stealing_scheduler& operator=(const work_stealing_scheduler&) = delete;
+
+	int64_t get_worker_count() const { return static_cast<int64_t>(workers.size()); }
+
+	// enqueue tasks with an initial assignment to workers (tasks_per_worker.size() must not exceed the worker count)
+	void submit(std::vector<std::vector<task>> tasks_per_worker);
+	// enqueue a single task on the given worker
+	void submit(int64_t worker_idx, task t);
+
+	// total number of tasks which were executed by a worker other than the one they were assigned to
+	int64_t get_steal_count() const { return steal_count.load(); }
+
+  private:
+	struct worker {
+		std::mutex mutex;
+		std::deque<task> tasks;
+		std::thread thread;
+	};
+	std::vector<std::unique_ptr<worker>> workers;
+
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+	int64_t pending_tasks = 0; // protected by sleep_mutex
+	bool stopping = false;     // protected by sleep_mutex
+	std::atomic<int64_t> steal_count = 0;
+
+	bool try_pop(int64_t worker_idx, task& t);
+	bool try_steal(int64_t worker_idx, task& t);
+	void work(int64_t worker_idx);
+};
+
+} // namespace copylib
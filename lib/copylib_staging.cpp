@@ -0,0 +1,176 @@
+#include "copylib_staging.hpp"
+
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <bit>
+
+namespace copylib {
+
+int64_t staging_pool::size_class(int64_t size) {
+	COPYLIB_ENSURE(size > 0, "Invalid staging region size: {}", size);
+	const auto rounded = (size + granularity - 1) / granularity * granularity;
+	const auto step = std::max(granularity, static_cast<int64_t>(std::bit_floor(static_cast<uint64_t>(rounded))) / 8);
+	return (rounded + step - 1) / step * step;
+}
+
+void staging_pool::add_buffer(device_id did, bool on_host, std::byte* buffer, int64_t size) {
+	add_buffer(did, on_host, size, [buffer] { return buffer; });
+}
+
+void staging_pool::add_buffer(device_id did, bool on_host, int64_t size, std::function<std::byte*()> allocate) {
+	COPYLIB_ENSURE(did != device_id::host, "Device id for staging cannot be host");
+	std::lock_guard lock(mutex);
+	const auto idx = arena_index(did, on_host);
+	if(arenas.size() <= idx) { arenas.resize(idx + 1); }
+	COPYLIB_ENSURE(arenas[idx].allocated_regions == 0, "Cannot replace the staging buffer of {} while it is in use", did);
+	arenas[idx] = arena{};
+	arenas[idx].allocate = std::move(allocate);
+	arenas[idx].size = size;
+}
+
+const staging_pool::arena& staging_pool::get_arena(const staging_request& req) const {
+	const auto idx = arena_index(req.did, req.on_host);
+	COPYLIB_ENSURE(idx < arenas.size() && (arenas[idx].buffer != nullptr || arenas[idx].allocate), "No staging buffer {}for device {}",
+	    req.on_host ? "on host " : "", req.did);
+	return arenas[idx];
+}
+
+bool staging_pool::is_satisfiable_locked(const std::vector<staging_request>& requests) const {
+	// the long-lived regions stay where they are, so the requests have to fit into the rest of each buffer (this ignores fragmentation)
+	std::vector<int64_t> requested_bytes(arenas.size(), 0);
+	for(const auto& req : requests) {
+		const auto& a = get_arena(req);
+		auto& requested = requested_bytes[arena_index(req.did, req.on_host)];
+		requested += size_class(req.size);
+		if(requested > a.size - a.long_lived_bytes) { return false; }
+	}
+	return true;
+}
+
+bool staging_pool::is_satisfiable(const std::vector<staging_request>& requests) const {
+	std::lock_guard lock(mutex);
+	return is_satisfiable_locked(requests);
+}
+
+bool staging_pool::try_allocate(arena& a, int64_t size, staging_region& region) {
+	const auto cls = size_class(size);
+	// prefer a free region of the same class, then fresh memory, and only then a free region of a larger class
+	auto it = a.free_lists.lower_bound(cls);
+	if(it == a.free_lists.end() || it->first != cls) {
+		if(a.bump_offset + cls <= a.size) {
+			region.offset = a.bump_offset;
+			region.size = cls;
+			a.bump_offset += cls;
+			it = a.free_lists.end();
+		} else if(it == a.free_lists.end()) {
+			return false;
+		}
+	}
+	if(it != a.free_lists.end()) {
+		region.offset = it->second.back();
+		region.size = it->first;
+		it->second.pop_back();
+		if(it->second.empty()) { a.free_lists.erase(it); }
+	}
+	region.ptr = a.buffer + region.offset;
+	a.allocated_bytes += region.size;
+	a.allocated_regions++;
+	return true;
+}
+
+void staging_pool::free_region(const staging_region& region) {
+	auto& a = arenas[arena_index(region.did, region.on_host)];
+	a.allocated_bytes -= region.size;
+	if(region.long_lived) {
+		a.long_lived_bytes -= region.size;
+		a.long_lived_regions--;
+	}
+	// once an arena is empty, start over from a clean slate rather than keeping its free lists fragmented
+	if(--a.allocated_regions == 0) {
+		a.bump_offset = 0;
+		a.free_lists.clear();
+	} else {
+		a.free_lists[region.size].push_back(region.offset);
+	}
+}
+
+std::vector<staging_region> staging_pool::acquire(const std::vector<staging_request>& requests, bool long_lived) {
+	std::vector<staging_region> regions;
+	regions.reserve(requests.size());
+	std::unique_lock lock(mutex);
+	const auto describe_overflow = [&](const staging_request& req) {
+		const auto& a = get_arena(req);
+		return utils::format("Staging buffer overflow {}for device {}: cannot allocate {} bytes in a staging buffer of {} bytes, of which {} bytes are held "
+		                     "by compiled copy sets or copy graphs",
+		    req.on_host ? "on host " : "", req.did, req.size, a.size, a.long_lived_bytes);
+	};
+	// waiting for requests which do not fit next to the long-lived regions would never end
+	if(!is_satisfiable_locked(requests)) {
+		for(const auto& req : requests) {
+			COPYLIB_ENSURE(is_satisfiable_locked({req}), "{}", describe_overflow(req));
+		}
+		COPYLIB_ERROR("Staging buffer overflow: {} requests cannot be allocated together next to the regions held by compiled copy sets or copy graphs",
+		    requests.size());
+	}
+	while(true) {
+		const staging_request* failed = nullptr;
+		for(const auto& req : requests) {
+			auto& a = arenas[arena_index(req.did, req.on_host)];
+			if(a.buffer == nullptr) {
+				a.buffer = a.allocate();
+				a.allocate = nullptr;
+			}
+			staging_region region{.did = req.did, .on_host = req.on_host, .long_lived = long_lived};
+			if(!try_allocate(a, req.size, region)) {
+				failed = &req;
+				break;
+			}
+			regions.push_back(region);
+		}
+		if(failed == nullptr) {
+			if(long_lived) {
+				for(const auto& region : regions) {
+					auto& a = arenas[arena_index(region.did, region.on_host)];
+					a.long_lived_bytes += region.size;
+					a.long_lived_regions++;
+				}
+			}
+			return regions;
+		}
+
+		// roll back, and wait for other users to release memory (unless only long-lived regions remain, in which case this can never succeed)
+		for(auto& region : regions) {
+			region.long_lived = false; // not counted as such yet
+			free_region(region);
+		}
+		regions.clear();
+		const auto& a = arenas[arena_index(failed->did, failed->on_host)];
+		COPYLIB_ENSURE(a.allocated_regions > a.long_lived_regions, "{}", describe_overflow(*failed));
+		released_cv.wait(lock);
+	}
+}
+
+void staging_pool::release(const std::vector<staging_region>& regions) {
+	if(regions.empty()) { return; }
+	{
+		std::lock_guard lock(mutex);
+		for(const auto& region : regions) {
+			free_region(region);
+		}
+	}
+	released_cv.notify_all();
+}
+
+int64_t staging_pool::get_allocated_bytes(device_id did, bool on_host) const {
+	std::lock_guard lock(mutex);
+	const auto idx = arena_index(did, on_host);
+	return idx < arenas.size() ? arenas[idx].allocated_bytes : 0;
+}
+
+int64_t staging_pool::get_long_lived_bytes(device_id did, bool on_host) const {
+	std::lock_guard lock(mutex);
+	const auto idx = arena_index(did, on_host);
+	return idx < arenas.size() ? arenas[idx].long_lived_bytes : 0;
+}
+
+} // namespace copylib
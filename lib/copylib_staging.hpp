@@ -0,0 +1,81 @@
+#pragma once
+
+#include "copylib_core.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace copylib {
+
+// a request for a staging region of (at least) size bytes in the staging buffer of a device (on the device, or on the host if on_host is set)
+struct staging_request {
+	device_id did = device_id::d0;
+	bool on_host = false;
+	int64_t size = 0;
+};
+
+// a region of a staging buffer handed out by a staging_pool
+struct staging_region {
+	device_id did = device_id::d0;
+	bool on_host = false;
+	int64_t offset = 0;
+	int64_t size = 0; // the size class of the region, which can be larger than requested
+	std::byte* ptr = nullptr;
+	bool long_lived = false; // see staging_pool::acquire
+};
+
+// hands out regions of the staging buffers of each device, recycling released regions through per-size-class free lists
+// it is thread-safe, so that concurrently executing copy sets each get their own staging memory
+class staging_pool {
+  public:
+	static constexpr int64_t granularity = 128; // all regions are aligned to (and a multiple of) this size
+
+	// round a size up to its size class; classes are at most 1/8 apart, which bounds the waste per region at 12.5%
+	static int64_t size_class(int64_t size);
+
+	// make the given buffer the staging buffer for the device (on the device, or on the host if on_host is set)
+	void add_buffer(device_id did, bool on_host, std::byte* buffer, int64_t size);
+	// as above, but the buffer is only obtained from allocate() once it is first needed
+	void add_buffer(device_id did, bool on_host, int64_t size, std::function<std::byte*()> allocate);
+
+	// allocate regions for all the requests at once; either all or none of them are allocated, so that concurrent callers cannot deadlock
+	// blocks until enough memory has been released by other users; it is an error if the requests can not be satisfied even once all regions but the
+	// long-lived ones are released, since those are held indefinitely (e.g. by compiled copy sets and copy graphs), which long_lived marks the regions as
+	std::vector<staging_region> acquire(const std::vector<staging_request>& requests, bool long_lived = false);
+	void release(const std::vector<staging_region>& regions);
+
+	// whether the requests fit into the staging buffers next to the long-lived regions, i.e. whether acquire can eventually succeed
+	bool is_satisfiable(const std::vector<staging_request>& requests) const;
+
+	// total size of the regions currently allocated in the given staging buffer, and of the long-lived ones among them
+	int64_t get_allocated_bytes(device_id did, bool on_host) const;
+	int64_t get_long_lived_bytes(device_id did, bool on_host) const;
+
+  private:
+	struct arena {
+		std::byte* buffer = nullptr;
+		std::function<std::byte*()> allocate; // if buffer has not been obtained yet
+		int64_t size = 0;
+		int64_t bump_offset = 0; // everything from here on has never been handed out (since the arena was last empty)
+		int64_t allocated_bytes = 0;
+		int64_t allocated_regions = 0;
+		int64_t long_lived_bytes = 0;
+		int64_t long_lived_regions = 0;
+		std::map<int64_t, std::vector<int64_t>> free_lists; // region offsets by size class
+	};
+	std::vector<arena> arenas; // indexed densely by device and host flag
+
+	mutable std::mutex mutex;
+	std::condition_variable released_cv;
+
+	static size_t arena_index(device_id did, bool on_host) { return static_cast<size_t>(did) * 2 + (on_host ? 1 : 0); }
+	const arena& get_arena(const staging_request& req) const;
+	bool is_satisfiable_locked(const std::vector<staging_request>& requests) const;
+	bool try_allocate(arena& a, int64_t size, staging_region& region);
+	void free_region(const staging_region& region);
+};
+
+} // namespace copylib
@@ -16,8 +16,10 @@ COPYLIB_OSTREAM_FOR(device_id)
 COPYLIB_OSTREAM_FOR(staging_id)
 COPYLIB_OSTREAM_FOR(data_layout)
 COPYLIB_OSTREAM_FOR(copy_properties)
+COPYLIB_OSTREAM_FOR(element_conversion)
 COPYLIB_OSTREAM_FOR(copy_spec)
 COPYLIB_OSTREAM_FOR(copy_type)
+COPYLIB_OSTREAM_FOR(memory_kind)
 COPYLIB_OSTREAM_FOR(d2d_implementation)
 COPYLIB_OSTREAM_FOR(copy_strategy)
 COPYLIB_OSTREAM_FOR(copy_plan)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "copylib_core.hpp"
+#include "copylib_registry.hpp"
 
 #include "utils.hpp"
 
@@ -24,10 +25,14 @@ struct hash<copylib::copy_properties> {
 template <>
 struct hash<copylib::copy_spec> {
 	size_t operator()(const copylib::copy_spec& spec) const {
-		return copylib::utils::hash_args(spec.source_device, spec.source_layout, spec.target_device, spec.target_layout, spec.properties);
+		return copylib::utils::hash_args(spec.source_device, spec.source_layout, spec.target_device, spec.target_layout, spec.properties, spec.conversion);
 	}
 };
 template <>
+struct hash<copylib::element_conversion> {
+	size_t operator()(const copylib::element_conversion& conversion) const { return hash<int>{}(static_cast<int>(conversion)); }
+};
+template <>
 struct hash<copylib::copy_plan> {
 	size_t operator()(const copylib::copy_plan& plan) const {
 		size_t val = 0;
@@ -64,6 +69,7 @@ template <>
 struct formatter<copylib::device_id> : formatter<std::string> {
 	auto format(const copylib::device_id& p, format_context& ctx) const {
 		if(p == copylib::device_id::host) { return formatter<std::string>::format("host", ctx); }
+		if(p == copylib::device_id::none) { return formatter<std::string>::format("none", ctx); }
 		return formatter<std::string>::format(copylib::utils::format("d{}", static_cast<int>(p)), ctx);
 	}
 };
@@ -90,15 +96,36 @@ struct formatter<copylib::copy_properties> : formatter<std::string> {
 		using namespace std::string_literals;
 		if(p & copylib::copy_properties::use_kernel) { result += "use_kernel"; }
 		if(p & copylib::copy_properties::use_2D_copy) { result += (result.empty() ? ""s : ","s) + "use_2D_copy"; }
+		if(p & copylib::copy_properties::use_compression) { result += (result.empty() ? ""s : ","s) + "use_compression"; }
+		if(p & copylib::copy_properties::use_zero_copy) { result += (result.empty() ? ""s : ","s) + "use_zero_copy"; }
 		return formatter<std::string>::format(result, ctx);
 	}
 };
 template <>
+struct formatter<copylib::element_conversion> : formatter<std::string> {
+	auto format(const copylib::element_conversion& p, format_context& ctx) const {
+		switch(p) {
+		case copylib::element_conversion::none: return formatter<std::string>::format("none", ctx);
+		case copylib::element_conversion::fp32_to_fp16: return formatter<std::string>::format("fp32_to_fp16", ctx);
+		case copylib::element_conversion::fp32_to_bf16: return formatter<std::string>::format("fp32_to_bf16", ctx);
+		case copylib::element_conversion::fp16_to_fp32: return formatter<std::string>::format("fp16_to_fp32", ctx);
+		case copylib::element_conversion::bf16_to_fp32: return formatter<std::string>::format("bf16_to_fp32", ctx);
+		default: COPYLIB_ERROR("Unknown element conversion {}", static_cast<int>(p));
+		}
+	}
+};
+template <>
 struct formatter<copylib::copy_spec> : formatter<std::string> {
 	auto format(const copylib::copy_spec& p, format_context& ctx) const {
 		using namespace std::string_literals;
 		auto prop_string = ""s;
-		if(p.properties != copylib::copy_properties::none) { prop_string = copylib::utils::format(" ({})", p.properties); }
+		if(p.properties != copylib::copy_properties::none && p.conversion != copylib::element_conversion::none) {
+			prop_string = copylib::utils::format(" ({}, {})", p.properties, p.conversion);
+		} else if(p.properties != copylib::copy_properties::none) {
+			prop_string = copylib::utils::format(" ({})", p.properties);
+		} else if(p.conversion != copylib::element_conversion::none) {
+			prop_string = copylib::utils::format(" ({})", p.conversion);
+		}
 		return formatter<std::string>::format(
 		    copylib::utils::format("copy({}{}, {}{}{})", p.source_device, p.source_layout, p.target_device, p.target_layout, prop_string), ctx);
 	}
@@ -114,6 +141,18 @@ struct formatter<copylib::copy_type> : formatter<std::string> {
 	}
 };
 template <>
+struct formatter<copylib::memory_kind> : formatter<std::string> {
+	auto format(const copylib::memory_kind& p, format_context& ctx) const {
+		switch(p) {
+		case copylib::memory_kind::device: return formatter<std::string>::format("device", ctx);
+		case copylib::memory_kind::host_pinned: return formatter<std::string>::format("host_pinned", ctx);
+		case copylib::memory_kind::host_pageable: return formatter<std::string>::format("host_pageable", ctx);
+		case copylib::memory_kind::shared: return formatter<std::string>::format("shared", ctx);
+		default: COPYLIB_ERROR("Unknown memory kind {}", static_cast<int>(p));
+		}
+	}
+};
+template <>
 struct formatter<copylib::d2d_implementation> : formatter<std::string> {
 	auto format(const copylib::d2d_implementation& p, format_context& ctx) const {
 		switch(p) {
@@ -163,8 +202,10 @@ ostream& operator<<(ostream& os, const copylib::device_id& p);
 ostream& operator<<(ostream& os, const copylib::staging_id& p);
 ostream& operator<<(ostream& os, const copylib::data_layout& p);
 ostream& operator<<(ostream& os, const copylib::copy_properties& p);
+ostream& operator<<(ostream& os, const copylib::element_conversion& p);
 ostream& operator<<(ostream& os, const copylib::copy_spec& p);
 ostream& operator<<(ostream& os, const copylib::copy_type& p);
+ostream& operator<<(ostream& os, const copylib::memory_kind& p);
 ostream& operator<<(ostream& os, const copylib::d2d_implementation& p);
 ostream& operator<<(ostream& os, const copylib::copy_strategy& p);
 ostream& operator<<(ostream& os, const copylib::copy_plan& p);
@@ -0,0 +1,287 @@
+#include "copylib_transport.hpp"
+
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace copylib {
+
+// the start of the shared memory object; the counters wrap around, which the slot count (a power of two) divides evenly
+struct shm_transport::header {
+	std::atomic<uint64_t> magic; // written last by the creator
+	int64_t slot_count;
+	int64_t slot_size;
+	alignas(64) std::atomic<uint32_t> committed; // slots committed by the sender, only written by it
+	alignas(64) std::atomic<uint32_t> released;  // slots released by the receiver, only written by it
+};
+
+struct shm_transport::slot_descriptor {
+	int64_t stream_offset;
+	int64_t bytes;
+};
+
+namespace {
+	constexpr uint64_t shm_transport_magic = 0x636f'70796c'696231; // "copylib1"
+	// slots are page aligned, which also satisfies the alignment requirements of pinning and of vectorized kernels reading them
+	constexpr int64_t shm_slot_alignment = 4096;
+	// the other side is commonly about to update a counter, so waiting spins this many times before sleeping on the futex
+	constexpr int shm_spin_iterations = 1000;
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futexes need plain 32 bit atomics");
+
+	int64_t get_descriptors_offset() { return (sizeof(shm_transport::header) + 63) / 64 * 64; }
+
+	int64_t get_slots_offset(int64_t slot_count) {
+		const auto descriptors_end = get_descriptors_offset() + slot_count * static_cast<int64_t>(sizeof(shm_transport::slot_descriptor));
+		return (descriptors_end + shm_slot_alignment - 1) / shm_slot_alignment * shm_slot_alignment;
+	}
+
+	int64_t get_aligned_slot_size(int64_t slot_size) { return (slot_size + shm_slot_alignment - 1) / shm_slot_alignment * shm_slot_alignment; }
+
+	int64_t get_mapping_size(int64_t slot_count, int64_t slot_size) { return get_slots_offset(slot_count) + slot_count * get_aligned_slot_size(slot_size); }
+
+	// the futexes live in memory shared between processes, so they can not use the private (process-local) variants
+	void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+	}
+
+	void futex_wake(std::atomic<uint32_t>& word) { syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0); }
+
+	// wait until the counter satisfies the predicate, and return its value then
+	template <typename Predicate>
+	uint32_t wait_for_counter(std::atomic<uint32_t>& counter, Predicate pred) {
+		for(int i = 0; i < shm_spin_iterations; i++) {
+			const auto value = counter.load(std::memory_order_acquire);
+			if(pred(value)) { return value; }
+		}
+		while(true) {
+			const auto value = counter.load(std::memory_order_acquire);
+			if(pred(value)) { return value; }
+			futex_wait(counter, value); // returns immediately if the counter has changed in the meantime
+		}
+	}
+} // namespace
+
+shm_transport::shm_transport(const std::string& name, int64_t slot_count, int64_t slot_size) : name(name), owner(true) {
+	COPYLIB_ENSURE(slot_count > 0 && slot_count <= (int64_t{1} << 16) && std::has_single_bit(static_cast<uint64_t>(slot_count)),
+	    "Invalid slot count for a shared memory transport: {} (needs to be a power of two up to 65536)", slot_count);
+	COPYLIB_ENSURE(slot_size > 0, "Invalid slot size for a shared memory transport: {}", slot_size);
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	COPYLIB_ENSURE(fd >= 0, "Could not create shared memory {}: {}", name, std::strerror(errno));
+	const auto size = get_mapping_size(slot_count, slot_size);
+	const bool resized = ftruncate(fd, size) == 0;
+	const auto resize_errno = errno;
+	if(!resized) {
+		close(fd);
+		shm_unlink(name.c_str());
+	}
+	COPYLIB_ENSURE(resized, "Could not resize shared memory {} to {} bytes: {}", name, size, std::strerror(resize_errno));
+	map(fd, size);
+
+	shared = new(mapping) header{};
+	shared->slot_count = slot_count;
+	shared->slot_size = get_aligned_slot_size(slot_size);
+	shared->magic.store(shm_transport_magic, std::memory_order_release);
+	descriptors = reinterpret_cast<slot_descriptor*>(mapping + get_descriptors_offset());
+	slots = mapping + get_slots_offset(slot_count);
+}
+
+shm_transport::shm_transport(const std::string& name, std::chrono::milliseconds timeout) : name(name) {
+	// the creator may not have created, resized or initialized the object yet
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	while(!try_attach()) {
+		COPYLIB_ENSURE(std::chrono::steady_clock::now() < deadline, "Shared memory {} did not become a transport within {} ms", name, timeout.count());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+std::unique_ptr<shm_transport> shm_transport::try_open(const std::string& name) {
+	std::unique_ptr<shm_transport> transport(new shm_transport(name, unattached{}));
+	if(!transport->try_attach()) { return nullptr; }
+	return transport;
+}
+
+shm_transport::~shm_transport() {
+	if(mapping != nullptr) { munmap(mapping, mapping_size); }
+	if(owner) { shm_unlink(name.c_str()); }
+}
+
+bool shm_transport::try_attach() {
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+	if(fd < 0) {
+		COPYLIB_ENSURE(errno == ENOENT, "Could not open shared memory {}: {}", name, std::strerror(errno));
+		return false;
+	}
+	struct stat st{};
+	if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(header))) {
+		close(fd);
+		return false;
+	}
+	map(fd, st.st_size);
+
+	// the creator stores the magic last, once the header is complete
+	const auto candidate = reinterpret_cast<header*>(mapping);
+	if(candidate->magic.load(std::memory_order_acquire) != shm_transport_magic || mapping_size != get_mapping_size(candidate->slot_count, candidate->slot_size)) {
+		munmap(mapping, mapping_size);
+		mapping = nullptr;
+		mapping_size = 0;
+		return false;
+	}
+	shared = candidate;
+	descriptors = reinterpret_cast<slot_descriptor*>(mapping + get_descriptors_offset());
+	slots = mapping + get_slots_offset(shared->slot_count);
+	// continue where a previous user of the same side left off
+	send_acquired = shared->committed.load(std::memory_order_acquire);
+	receive_acquired = shared->released.load(std::memory_order_acquire);
+	return true;
+}
+
+void shm_transport::map(int fd, int64_t size) {
+	void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const auto mmap_errno = errno;
+	close(fd); // the mapping keeps the object open
+	if(ptr == MAP_FAILED && owner) { shm_unlink(name.c_str()); }
+	COPYLIB_ENSURE(ptr != MAP_FAILED, "Could not map shared memory {}: {}", name, std::strerror(mmap_errno));
+	mapping = static_cast<std::byte*>(ptr);
+	mapping_size = size;
+}
+
+int64_t shm_transport::get_slot_count() const { return shared->slot_count; }
+int64_t shm_transport::get_slot_size() const { return shared->slot_size; }
+
+std::byte* shm_transport::acquire_send_slot() {
+	const auto slot_count = static_cast<uint32_t>(shared->slot_count);
+	COPYLIB_ENSURE(send_acquired - shared->committed.load(std::memory_order_relaxed) < slot_count, "All {} slots of {} are acquired already", slot_count, name);
+	wait_for_counter(shared->released, [&](uint32_t released) { return send_acquired - released < slot_count; });
+	return slots + (send_acquired++ % slot_count) * get_slot_size();
+}
+
+void shm_transport::commit_send_slot(int64_t stream_offset, int64_t bytes) {
+	const auto committed = shared->committed.load(std::memory_order_relaxed);
+	COPYLIB_ENSURE(committed != send_acquired, "No slot of {} to commit", name);
+	COPYLIB_ENSURE(bytes >= 0 && bytes <= shared->slot_size, "Chunk of {} bytes does not fit the slots of {}", bytes, name);
+	descriptors[committed % shared->slot_count] = {stream_offset, bytes};
+	shared->committed.store(committed + 1, std::memory_order_release);
+	futex_wake(shared->committed);
+}
+
+transport::received_slot shm_transport::acquire_receive_slot() {
+	const auto slot_count = static_cast<uint32_t>(shared->slot_count);
+	COPYLIB_ENSURE(receive_acquired - shared->released.load(std::memory_order_relaxed) < slot_count, "All {} slots of {} are acquired already", slot_count, name);
+	wait_for_counter(shared->committed, [&](uint32_t committed) { return committed != receive_acquired; });
+	const auto idx = receive_acquired++ % slot_count;
+	return {slots + idx * get_slot_size(), descriptors[idx].stream_offset, descriptors[idx].bytes};
+}
+
+void shm_transport::release_receive_slot() {
+	const auto released = shared->released.load(std::memory_order_relaxed);
+	COPYLIB_ENSURE(released != receive_acquired, "No slot of {} to release", name);
+	shared->released.store(released + 1, std::memory_order_release);
+	futex_wake(shared->released);
+}
+
+namespace {
+	// the parts of a layout holding the bytes [begin, end) of its linearization: partial fragments at either end, and the whole fragments in between
+	std::vector<data_layout> get_stream_range_layouts(const data_layout& layout, int64_t begin, int64_t end) {
+		if(layout.unit_stride()) { return {data_layout{layout.base, layout.offset + begin, end - begin}}; }
+		const auto length = layout.fragment_length;
+		std::vector<data_layout> parts;
+		if(begin % length != 0) {
+			const auto part_end = std::min(end, (begin / length + 1) * length);
+			parts.push_back(data_layout{layout.base, layout.fragment_offset(begin / length) + begin % length, part_end - begin});
+			begin = part_end;
+		}
+		if(const auto whole_fragments = (end - begin) / length; whole_fragments > 0) {
+			parts.push_back(data_layout{layout.base, layout.fragment_offset(begin / length), length, whole_fragments, layout.stride});
+			begin += whole_fragments * length;
+		}
+		if(begin < end) { parts.push_back(data_layout{layout.base, layout.fragment_offset(begin / length), end - begin}); }
+		return parts;
+	}
+} // namespace
+
+void copy_device_to_transport(executor& exec, device_id did, const data_layout& source, transport& channel) {
+	COPYLIB_ENSURE(did != device_id::host, "Only device layouts can be sent through a transport, use a host copy to its slots instead");
+	const copy_spec spec{did, source, device_id::host, data_layout{0, 0, source.total_bytes()}}; // placeholder target, replaced by the slots
+	auto set = manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::use_kernel, channel.get_slot_size()}, basic_staging_provider{});
+
+	// chunk i is transferred into the i-th slot acquired; slots are committed in order, as soon as their transfer is complete
+	struct chunk_in_flight {
+		copy_handle transfer;
+		int64_t stream_offset;
+		int64_t bytes;
+	};
+	std::deque<chunk_in_flight> in_flight;
+	const auto commit_oldest = [&] {
+		const auto& chunk = in_flight.front();
+		chunk.transfer.wait();
+		channel.commit_send_slot(chunk.stream_offset, chunk.bytes);
+		in_flight.pop_front();
+	};
+	int64_t stream_offset = 0;
+	for(auto& plan : set) {
+		const auto bytes = plan.back().target_layout.total_bytes();
+		COPYLIB_ENSURE(bytes <= channel.get_slot_size(), "Chunk of {} bytes does not fit a slot of {} bytes", bytes, channel.get_slot_size());
+		if(static_cast<int64_t>(in_flight.size()) == channel.get_slot_count()) { commit_oldest(); }
+		const auto slot = channel.acquire_send_slot();
+		plan.back().target_layout = data_layout{reinterpret_cast<intptr_t>(slot), 0, bytes};
+		in_flight.push_back({execute_copy_async(exec, {plan}), stream_offset, bytes});
+		stream_offset += bytes;
+	}
+	while(!in_flight.empty()) {
+		commit_oldest();
+	}
+}
+
+void copy_transport_to_device(executor& exec, transport& channel, device_id did, const data_layout& target) {
+	COPYLIB_ENSURE(did != device_id::host, "Only device layouts can be received from a transport, use a host copy from its slots instead");
+	const auto total_bytes = target.total_bytes();
+
+	// slot i is transferred and unstaged into the part of the target it holds, and released in order once that is complete
+	std::deque<copy_handle> in_flight;
+	const auto release_oldest = [&] {
+		in_flight.front().wait();
+		channel.release_receive_slot();
+		in_flight.pop_front();
+	};
+	int64_t received_bytes = 0;
+	while(received_bytes < total_bytes) {
+		if(static_cast<int64_t>(in_flight.size()) == channel.get_slot_count()) { release_oldest(); }
+		const auto slot = channel.acquire_receive_slot();
+		COPYLIB_ENSURE(slot.stream_offset == received_bytes && slot.bytes > 0 && received_bytes + slot.bytes <= total_bytes,
+		    "Unexpected chunk of {} bytes at stream offset {} after {} of {} bytes received", slot.bytes, slot.stream_offset, received_bytes, total_bytes);
+
+		parallel_copy_set set;
+		basic_staging_provider staging_provider;
+		int64_t slot_offset = 0;
+		for(const auto& part : get_stream_range_layouts(target, received_bytes, received_bytes + slot.bytes)) {
+			const copy_spec spec{device_id::host, data_layout{reinterpret_cast<intptr_t>(slot.data), slot_offset, part.total_bytes()}, did, part};
+			for(auto& plan : manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::use_kernel}, std::ref(staging_provider))) {
+				set.push_back(std::move(plan));
+			}
+			slot_offset += part.total_bytes();
+		}
+		in_flight.push_back(execute_copy_async(exec, set));
+		received_bytes += slot.bytes;
+	}
+	while(!in_flight.empty()) {
+		release_oldest();
+	}
+}
+
+} // namespace copylib
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "copylib_backend.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace copylib {
+
+// one direction of a channel between two processes, through which a linearized stream of bytes is sent in chunks held by a ring of slots
+// the sender fills and commits slots in order, the receiver consumes and releases them in order; each side is used by a single thread
+class transport {
+  public:
+	// a committed slot: the chunk it holds, and where the chunk starts in the stream
+	struct received_slot {
+		const std::byte* data = nullptr;
+		int64_t stream_offset = 0;
+		int64_t bytes = 0;
+	};
+
+	virtual ~transport() = default;
+
+	virtual int64_t get_slot_count() const = 0;
+	virtual int64_t get_slot_size() const = 0;
+	// the memory holding all slots, e.g. to pin it with the executor
+	virtual std::byte* get_slot_memory() const = 0;
+	virtual int64_t get_slot_memory_size() const = 0;
+
+	// sender: the next slot to fill, blocking until the receiver has released it; at most get_slot_count() slots can be acquired but not committed
+	virtual std::byte* acquire_send_slot() = 0;
+	// sender: hand the oldest acquired slot to the receiver, holding `bytes` bytes of the stream starting at `stream_offset`
+	virtual void commit_send_slot(int64_t stream_offset, int64_t bytes) = 0;
+
+	// receiver: the next committed slot, blocking until the sender has committed it
+	virtual received_slot acquire_receive_slot() = 0;
+	// receiver: hand the oldest acquired slot back to the sender
+	virtual void release_receive_slot() = 0;
+};
+
+// a transport through POSIX shared memory: the slot descriptors form a lock-free single-producer single-consumer ring, and waiting sides sleep on futexes
+// one process creates the named shared memory object (and removes it again on destruction), the other opens it once it exists
+class shm_transport final : public transport {
+  public:
+	// create the shared memory object `name` (e.g. "/copylib-0-to-1") with slot_count (a power of two) slots of slot_size bytes each
+	shm_transport(const std::string& name, int64_t slot_count, int64_t slot_size);
+	// open the shared memory object `name` created by another process, waiting up to timeout for the creator to set it up
+	explicit shm_transport(const std::string& name, std::chrono::milliseconds timeout = std::chrono::seconds(10));
+	~shm_transport() override;
+
+	// as above, but without waiting: none if `name` does not exist, or has not been set up as a transport by its creator yet
+	static std::unique_ptr<shm_transport> try_open(const std::string& name);
+
+	shm_transport(const shm_transport&) = delete;
+	shm_transport& operator=(const shm_transport&) = delete;
+
+	int64_t get_slot_count() const override;
+	int64_t get_slot_size() const override;
+	std::byte* get_slot_memory() const override { return slots; }
+	int64_t get_slot_memory_size() const override { return get_slot_count() * get_slot_size(); }
+
+	std::byte* acquire_send_slot() override;
+	void commit_send_slot(int64_t stream_offset, int64_t bytes) override;
+	received_slot acquire_receive_slot() override;
+	void release_receive_slot() override;
+
+	struct header;
+	struct slot_descriptor;
+
+  private:
+	std::string name;
+	bool owner = false;
+	std::byte* mapping = nullptr;
+	int64_t mapping_size = 0;
+	header* shared = nullptr;
+	slot_descriptor* descriptors = nullptr;
+	std::byte* slots = nullptr;
+	// the slots acquired by this side so far, counting like the shared committed / released counters
+	uint32_t send_acquired = 0;
+	uint32_t receive_acquired = 0;
+
+	struct unattached {};
+	shm_transport(const std::string& name, unattached) : name(name) {}
+
+	void map(int fd, int64_t size);
+	// open and map an existing object; false (leaving nothing mapped) if it is not a complete transport yet
+	bool try_attach();
+};
+
+// send the (possibly strided) source layout on device `did` linearized through the transport: chunks of at most the slot size are linearized on the device
+// and transferred into the slots, which are committed in order as their transfers complete; pin the slot memory with the executor for full bandwidth
+void copy_device_to_transport(executor& exec, device_id did, const data_layout& source, transport& channel);
+
+// receive a stream sent with copy_device_to_transport into the (possibly strided) target layout on device `did`, which needs to be as large as the stream;
+// each slot is transferred and unstaged into the target layout as soon as it is committed, and released once that is complete
+void copy_transport_to_device(executor& exec, transport& channel, device_id did, const data_layout& target);
+
+} // namespace copylib
@@ -4,6 +4,13 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators_range.hpp>
 
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <unistd.h>
+
 using namespace copylib;
 
 // utility for checking validity of a buffer on a device and signaling the result to the host
@@ -107,6 +114,51 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "executor info dump", "[executor]"
 	utils::print("Tests will be included or excluded based on the available capabilities\n");
 }
 
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "buffers can be registered with the executor", "[executor]") {
+	// the executor's own buffers are registered once allocated
+	const auto dev_buffer = exec.get_buffer(device_id::d0);
+	CHECK(exec.get_memory_kind(dev_buffer + 100, device_id::d0) == memory_kind::device);
+	CHECK(exec.get_memory_kind(exec.get_host_buffer(device_id::d0), device_id::host) == memory_kind::host_pinned);
+
+	std::vector<std::byte> pageable(4096);
+	CHECK(exec.get_memory_kind(pageable.data(), device_id::host) == memory_kind::host_pageable);
+	exec.register_buffer(pageable.data(), pageable.size(), device_id::host, memory_kind::host_pageable);
+	CHECK(exec.get_registry().find(reinterpret_cast<intptr_t>(pageable.data()) + 4095)->kind == memory_kind::host_pageable);
+
+	const auto pinned = sycl::malloc_host<std::byte>(4096, exec.get_queue(device_id::d0));
+	CHECK(exec.get_memory_kind(pinned, device_id::host) == memory_kind::host_pinned);
+	exec.register_buffer(pinned, 4096, device_id::host, memory_kind::host_pinned);
+
+	// copies within the registered bounds are executed
+	const copy_spec spec{device_id::host, {reinterpret_cast<intptr_t>(pageable.data()), 0, 4096}, device_id::host, {reinterpret_cast<intptr_t>(pinned), 0, 4096}};
+	std::ranges::fill(pageable, std::byte{42});
+	execute_copy(exec, parallel_copy_set{{spec}});
+	CHECK(std::all_of(pinned, pinned + 4096, [](std::byte b) { return b == std::byte{42}; }));
+
+	exec.unregister_buffer(pinned);
+	exec.unregister_buffer(pageable.data());
+	sycl::free(pinned, exec.get_queue(device_id::d0));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "kernel copies from pinned host memory are correct with and without zero-copy", "[executor]") {
+	const bool zero_copy = GENERATE(false, true);
+	CAPTURE(zero_copy);
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_host_buffer(device_id::d0));
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 0, 16, 128, 32};
+	const data_layout tgt_layout{tgt_buffer, 0, 16, 128, 48};
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d0, tgt_buffer, buffer_size, 66);
+
+	const auto properties = zero_copy ? copy_properties::use_kernel | copy_properties::use_zero_copy : copy_properties::use_kernel;
+	const copy_spec spec{device_id::host, src_layout, device_id::d0, tgt_layout, properties};
+	REQUIRE(is_valid(spec));
+	execute_copy(exec, parallel_copy_set{{spec}});
+
+	CHECK(validate_target(exec, device_id::d0, tgt_buffer, tgt_layout, src_layout));
+}
+
 TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "basic copies can be executed", "[executor]") {
 	const int64_t copy_extent = GENERATE(1024, 76);
 	CAPTURE(copy_extent);
@@ -161,7 +213,7 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "2D copies can be executed", "[exe
 	auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
 	const int64_t source_offset = GENERATE(0, 32);
 	CAPTURE(source_offset);
-	const int64_t source_frag_length = GENERATE(8, 32);
+	const int64_t source_frag_length = GENERATE(8, 32, 96);
 	CAPTURE(source_frag_length);
 	const int64_t source_frag_count = GENERATE(16, 32);
 	CAPTURE(source_frag_count);
@@ -217,6 +269,86 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "2D copies can be executed", "[exe
 	CHECK(validate_target(exec, tgt_device, tgt_buffer, target_layout, source_layout));
 }
 
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "kernel copies between misaligned layouts", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const auto tgt_buffer = src_buffer + buffer_size;
+	const data_layout src_layout{src_buffer, 4, 4000, 16, 4096};
+	// a target misaligned by the same amount as the source can be peeled, the other one can only use narrow elements
+	const int64_t target_offset = GENERATE(68, 72);
+	CAPTURE(target_offset);
+	const data_layout target_layout{tgt_buffer, target_offset, 4000, 16, 4160};
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d0, tgt_buffer, buffer_size, 66);
+
+	const copy_spec spec{device_id::d0, src_layout, device_id::d0, target_layout, copy_properties::use_kernel};
+	REQUIRE(is_valid(spec));
+	execute_copy(exec, parallel_copy_set{{spec}});
+
+	CHECK(validate_target(exec, device_id::d0, tgt_buffer, target_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "kernel copies between tiny strided fragments and contiguous layouts", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const auto tgt_buffer = src_buffer + buffer_size;
+	const int64_t fragment_length = GENERATE(4, 8, 12, 16);
+	const bool gather = GENERATE(true, false);
+	CAPTURE(fragment_length, gather);
+	// an odd fragment count leaves a partial work-group
+	const data_layout strided_layout{gather ? src_buffer : tgt_buffer, 4, fragment_length, 1001, 512};
+	const data_layout linear_layout{gather ? tgt_buffer : src_buffer, 0, fragment_length * 1001};
+	const auto& src_layout = gather ? strided_layout : linear_layout;
+	const auto& target_layout = gather ? linear_layout : strided_layout;
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d0, tgt_buffer, buffer_size, 66);
+
+	const copy_spec spec{device_id::d0, src_layout, device_id::d0, target_layout, copy_properties::use_kernel};
+	REQUIRE(is_valid(spec));
+	execute_copy(exec, parallel_copy_set{{spec}});
+
+	CHECK(validate_target(exec, device_id::d0, tgt_buffer, target_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "kernel copies of odd extents use tuned configurations", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const auto tgt_buffer = src_buffer + buffer_size;
+	const bool tuned = GENERATE(false, true);
+	CAPTURE(tuned);
+	if(tuned) {
+		exec.autotune_kernel_copies();
+		const auto& tuning = exec.get_kernel_tuning(device_id::d0);
+		for(const auto element_size : kernel_tuning::element_sizes) {
+			for(const auto fragments : {fragment_class::single_element, fragment_class::short_fragments, fragment_class::long_fragments}) {
+				const auto& config = tuning.get(element_size, fragments);
+				CHECK(config.wg_size > 0);
+				CHECK((config.items_per_thread == 1 || config.items_per_thread == 2 || config.items_per_thread == 4 || config.items_per_thread == 8));
+			}
+		}
+	}
+
+	// a prime fragment count and odd fragment lengths (in elements), which no work-group size divides
+	const int64_t fragment_length = GENERATE(4, 12, 28, 332);
+	CAPTURE(fragment_length);
+	const data_layout src_layout{src_buffer, 0, fragment_length, 1009, fragment_length * 2};
+	const data_layout tgt_layout{tgt_buffer, 0, fragment_length * 1009};
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d0, tgt_buffer, buffer_size, 66);
+
+	const copy_spec spec{device_id::d0, src_layout, device_id::d0, tgt_layout, copy_properties::use_kernel};
+	REQUIRE(is_valid(spec));
+	execute_copy(exec, parallel_copy_set{{spec}});
+
+	CHECK(validate_target(exec, device_id::d0, tgt_buffer, tgt_layout, src_layout));
+
+	// the executor is shared by all tests, which should not depend on whether this one ran before them
+	exec.reset_kernel_tuning();
+	const auto& config = exec.get_kernel_tuning(device_id::d0).get(sizeof(uint32_t), fragment_class::short_fragments);
+	CHECK(config.wg_size == exec.get_preferred_wg_size());
+	CHECK(config.items_per_thread == 1);
+}
+
 TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "copy plans can be executed", "[executor]") {
 	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
 	const data_layout source_layout{src_buffer, 0, 16, 20, 256};
@@ -252,7 +384,8 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "chunked copy can be executed", "[
 	CAPTURE(props);
 	const copy_type type = GENERATE(copy_type::direct, copy_type::staged);
 	CAPTURE(type);
-	const size_t expected_stages = type == copy_type::direct ? 1 : 3;
+	// with kernels, the copy within the device is performed directly rather than staged
+	const size_t expected_stages = type == copy_type::direct || props == copy_properties::use_kernel ? 1 : 3;
 
 	const auto chunk_size = GENERATE(32, 77);
 	CAPTURE(chunk_size);
@@ -278,6 +411,139 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "chunked copy can be executed", "[
 	CHECK(validate_target(exec, device_id::d0, tgt_buffer, target_layout, source_layout));
 }
 
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "small kernel copies of chunked copy sets are batched across devices", "[executor]") {
+	if(!exec.is_device_to_device_copy_available()) { return; }
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 16, 16, 1000, 48};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, 32, 16, 1000, 80};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+
+	// staging on d0, transfer, and unstaging on d1; the (un)staging kernels of all chunks are each performed by one launch
+	const auto chunk_size = GENERATE(256, 1024 + 16);
+	CAPTURE(chunk_size);
+	const auto copy_set = manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::use_kernel, chunk_size}, basic_staging_provider{});
+	REQUIRE(copy_set.front().size() == 3);
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+
+	execute_copy(exec, copy_set);
+
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "compiled copy sets can be executed repeatedly", "[executor]") {
+	if(!exec.is_device_to_device_copy_available()) { return; }
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 16, 16, 1000, 48};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, 32, 16, 1000, 80};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+
+	// small chunks are batched, large ones are executed plan by plan
+	const auto chunk_size = GENERATE(256, 128 * 1024);
+	CAPTURE(chunk_size);
+	const auto compiled =
+	    compile(exec, manifest_strategy(spec, copy_strategy{copy_type::staged, copy_properties::use_kernel, chunk_size}, basic_staging_provider{}));
+	CHECK(compiled.get_imbalance() >= 1.0);
+
+	for(int i = 0; i < 3; i++) {
+		fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+		fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+		execute_copy(exec, compiled);
+		CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+	}
+
+	execute_copy(exec, compiled_copy_set{}); // nothing to do
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "copies can convert elements", "[executor]") {
+	const auto narrow_device = exec.is_device_to_device_copy_available() ? GENERATE(device_id::d0, device_id::d1) : device_id::d0;
+	const auto conversion = GENERATE(element_conversion::fp32_to_fp16, element_conversion::fp32_to_bf16);
+	const auto widening = conversion == element_conversion::fp32_to_fp16 ? element_conversion::fp16_to_fp32 : element_conversion::bf16_to_fp32;
+	const auto chunk_size = GENERATE(0, 1024);
+	CAPTURE(narrow_device, conversion, chunk_size);
+
+	// the values are exactly representable in both narrow types, so that the round trip restores them
+	constexpr int64_t count = 1024;
+	std::vector<float> values(count);
+	for(int64_t i = 0; i < count; i++) {
+		values[i] = static_cast<float>(i - count / 2) * 0.25f;
+	}
+	const auto wide_buffer = exec.get_buffer(device_id::d0);
+	const data_layout wide_layout{reinterpret_cast<intptr_t>(wide_buffer), 16, 16, count / 4, 64};
+	const auto narrow_buffer = exec.get_buffer(narrow_device) + (narrow_device == device_id::d0 ? buffer_size : 0);
+	const data_layout narrow_layout{reinterpret_cast<intptr_t>(narrow_buffer), 0, count * 2};
+	const data_layout round_trip_layout{reinterpret_cast<intptr_t>(wide_buffer), buffer_size / 2, 16, count / 4, 48};
+
+	auto& q = exec.get_queue(device_id::d0);
+	for(int64_t f = 0; f < count / 4; f++) {
+		q.copy(values.data() + f * 4, reinterpret_cast<float*>(wide_buffer + wide_layout.fragment_offset(f)), 4);
+	}
+	q.wait_and_throw();
+
+	const copy_strategy strategy{copy_type::staged, copy_properties::use_kernel, chunk_size};
+	const copy_spec narrowing_spec{device_id::d0, wide_layout, narrow_device, narrow_layout, copy_properties::none, conversion};
+	execute_copy(exec, manifest_strategy(narrowing_spec, strategy, basic_staging_provider{}));
+	const copy_spec widening_spec{narrow_device, narrow_layout, device_id::d0, round_trip_layout, copy_properties::none, widening};
+	execute_copy(exec, manifest_strategy(widening_spec, strategy, basic_staging_provider{}));
+
+	std::vector<uint16_t> narrow_values(count);
+	exec.get_queue(narrow_device).copy(reinterpret_cast<const uint16_t*>(narrow_buffer), narrow_values.data(), count).wait_and_throw();
+	std::vector<float> round_trip_values(count);
+	for(int64_t f = 0; f < count / 4; f++) {
+		q.copy(reinterpret_cast<const float*>(wide_buffer + round_trip_layout.fragment_offset(f)), round_trip_values.data() + f * 4, 4);
+	}
+	q.wait_and_throw();
+
+	for(int64_t i = 0; i < count; i++) {
+		const auto bits = std::bit_cast<uint32_t>(values[i]);
+		REQUIRE(narrow_values[i] == (conversion == element_conversion::fp32_to_fp16 ? fp32_to_fp16_bits(bits) : fp32_to_bf16_bits(bits)));
+		REQUIRE(round_trip_values[i] == values[i]);
+	}
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "host staging of device to device copies can be compressed", "[executor]") {
+	const auto impl = GENERATE(d2d_implementation::host_staging_at_source, d2d_implementation::host_staging_at_target);
+	// a size which is not a multiple of the vector size leaves a partial block, and packs bytes
+	const int64_t bytes = GENERATE(64 * 1024, 64 * 1024 + 100);
+	const bool sparse = GENERATE(true, false);
+	// chunks placed in pipeline slots get their compression counters from the pipeline rather than from a fulfiller
+	const bool pipelined = GENERATE(false, true);
+	CAPTURE(impl, bytes, sparse, pipelined);
+
+	std::vector<uint8_t> data(bytes, sparse ? 0 : 0x12);
+	for(int64_t i = 0; i < bytes; i += 4099) {
+		data[i] = static_cast<uint8_t>(i % 251 + 1);
+	}
+	data.back() = 7;
+	const auto src_buffer = exec.get_buffer(device_id::d0);
+	const auto tgt_buffer = exec.get_buffer(device_id::d1);
+	exec.get_queue(device_id::d0).copy(data.data(), reinterpret_cast<uint8_t*>(src_buffer), bytes).wait_and_throw();
+	fill_uniform(exec, device_id::d1, reinterpret_cast<intptr_t>(tgt_buffer), buffer_size, 66);
+
+	const copy_spec spec{device_id::d0, {reinterpret_cast<intptr_t>(src_buffer), 0, bytes}, device_id::d1, {reinterpret_cast<intptr_t>(tgt_buffer), 0, bytes}};
+	const copy_strategy strategy{copy_type::staged, copy_properties::use_compression, impl, pipelined ? 16 * 1024 : 0};
+	const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+	REQUIRE(copy_set.front().size() == 2);
+	REQUIRE(copy_set.front().front().properties & copy_properties::use_compression);
+	if(pipelined) {
+		execute_copy_pipelined(exec, copy_set, 2);
+	} else {
+		execute_copy(exec, copy_set);
+	}
+
+	std::vector<uint8_t> result(bytes);
+	exec.get_queue(device_id::d1).copy(reinterpret_cast<const uint8_t*>(tgt_buffer), result.data(), bytes).wait_and_throw();
+	CHECK(result == data);
+	// the staging, including the counters, is returned to the pool
+	for(const auto did : {device_id::d0, device_id::d1}) {
+		CHECK(exec.get_staging_pool().get_allocated_bytes(did, false) == 0);
+		CHECK(exec.get_staging_pool().get_allocated_bytes(did, true) == 0);
+	}
+}
+
 TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "fully manifested device to device copy sets can be executed", "executor") {
 	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
 	const data_layout src_layout{src_buffer, 0, 16, 128, 32};
@@ -311,3 +577,255 @@ TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "fully manifested device to device
 
 	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
 }
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "copy sets with sparse or high staging indices can be executed", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 0, 16, 128, 32};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, src_layout};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+	const copy_strategy strat{copy_type::staged, copy_properties::use_kernel, d2d_implementation::host_staging_at_both, 256};
+
+	// a provider shared with earlier sets starts at high indices, while one spreading its indices leaves large gaps
+	const uint32_t index_step = GENERATE(1u, 100000u);
+	CAPTURE(index_step);
+	const staging_buffer_provider provider = [next = uint32_t{1000000}, index_step](device_id did, bool on_host, int64_t) mutable {
+		const auto index = next;
+		next += index_step;
+		return staging_id{on_host, did, index};
+	};
+	const auto copy_set = manifest_strategy(spec, strat, provider);
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+	execute_copy(exec, copy_set);
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "chunked copy sets can be executed as a pipeline", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 0, 16, 128, 48};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, 32, 16, 128, 64};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+
+	const copy_properties props = GENERATE(copy_properties::none, copy_properties::use_kernel);
+	CAPTURE(props);
+	const d2d_implementation d2d =
+	    GENERATE(d2d_implementation::host_staging_at_source, d2d_implementation::host_staging_at_target, d2d_implementation::host_staging_at_both);
+	CAPTURE(d2d);
+	const int64_t staging_slots = GENERATE(1, 2, 3);
+	CAPTURE(staging_slots);
+
+	// 208 is not a multiple of the fragment length, so the tail chunk is smaller than the others
+	const copy_strategy strat{copy_type::staged, props, d2d, 208};
+	auto copy_set = manifest_strategy(spec, strat, basic_staging_provider{});
+	REQUIRE(is_equivalent(copy_set, spec));
+	REQUIRE(copy_set.size() > static_cast<size_t>(staging_slots));
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+
+	execute_copy_pipelined(exec, copy_set, staging_slots);
+
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "pageable host memory is bounced through pinned staging in pipelined copies", "[executor]") {
+	std::vector<std::byte> source(128 * 64), result(128 * 64);
+	for(size_t i = 0; i < source.size(); ++i) {
+		source[i] = static_cast<std::byte>(i % 251);
+	}
+	const data_layout host_src_layout{reinterpret_cast<intptr_t>(source.data()), 0, 16, 128, 64};
+	const data_layout host_tgt_layout{reinterpret_cast<intptr_t>(result.data()), 0, 16, 128, 64};
+	const auto dev_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout dev_layout{dev_buffer, 0, 16, 128, 16};
+
+	const copy_strategy strat{copy_type::direct, copy_properties::none, d2d_implementation::direct, 512};
+	const auto h2d_set = manifest_strategy(copy_spec{device_id::host, host_src_layout, device_id::d0, dev_layout}, strat, basic_staging_provider{});
+	const auto bounced_set = bounce_pageable_host_memory(exec, h2d_set);
+	REQUIRE(bounced_set.size() == h2d_set.size());
+	CHECK(bounced_set.front().size() == 2);
+
+	execute_copy_pipelined(exec, h2d_set, 2);
+	execute_copy_pipelined(exec, manifest_strategy(copy_spec{device_id::d0, dev_layout, device_id::host, host_tgt_layout}, strat, basic_staging_provider{}), 2);
+
+	for(int64_t i = 0; i < host_src_layout.fragment_count; ++i) {
+		CHECK(std::equal(source.begin() + i * 64, source.begin() + i * 64 + 16, result.begin() + i * 64));
+	}
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "files can be streamed to strided device layouts", "[executor][file]") {
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout = GENERATE(data_layout{0, 32, 16, 1024, 64}, data_layout{0, 64, 16 * 1024});
+	const auto target_layout = data_layout{tgt_buffer, tgt_layout};
+	CAPTURE(target_layout);
+	const int64_t chunk_size = GENERATE(1024, 4096 - 16);
+	CAPTURE(chunk_size);
+
+	// the file holds the linearized data after a header, in the pattern expected by validate_target
+	const int64_t header_bytes = 64;
+	const auto path = std::filesystem::temp_directory_path() / "copylib_file_to_device_test.bin";
+	{
+		std::vector<uint32_t> contents(header_bytes / sizeof(uint32_t), 0);
+		for(int64_t i = 0; i < target_layout.total_bytes() / static_cast<int64_t>(sizeof(uint32_t)); i++) {
+			contents.push_back(42 + i);
+		}
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(contents.data()), contents.size() * sizeof(uint32_t));
+	}
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+	const auto registered_buffers = exec.get_registry().size();
+
+	copy_file_to_device(exec, path.string(), header_bytes, device_id::d1, target_layout, chunk_size);
+
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, target_layout, data_layout{0, 0, target_layout.total_bytes()}));
+	// the mapping is no longer registered once the copy is done
+	CHECK(exec.get_registry().size() == registered_buffers);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "strided device layouts can be streamed to files", "[executor][file]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	// fragments of 44 bytes only add up to direct write alignment in chunks of 1024 fragments, far beyond the requested chunk size
+	const data_layout src_layout = GENERATE(data_layout{0, 0, 48, 1000, 64}, data_layout{0, 0, 48 * 1000}, data_layout{0, 0, 44, 1000, 64});
+	const auto source_layout = data_layout{src_buffer, src_layout};
+	CAPTURE(source_layout);
+	const int64_t file_offset = GENERATE(0, 100);
+	CAPTURE(file_offset);
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, source_layout, 42);
+
+	// an existing, longer file ends after the written data afterwards
+	const auto path = std::filesystem::temp_directory_path() / "copylib_device_to_file_test.bin";
+	std::filesystem::remove(path);
+	std::ofstream(path, std::ios::binary) << std::string(file_offset + source_layout.total_bytes() + 5000, 'x');
+	copy_device_to_file(exec, device_id::d0, source_layout, path.string(), file_offset, 8192);
+	CHECK(std::filesystem::file_size(path) == static_cast<uintmax_t>(file_offset + source_layout.total_bytes()));
+
+	// read it back into a differently strided layout on the other device
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const int64_t tgt_fragment_length = src_layout.fragment_count > 1 ? src_layout.fragment_length : 48;
+	const data_layout tgt_layout{tgt_buffer, 16, tgt_fragment_length, src_layout.total_bytes() / tgt_fragment_length, 96};
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+	copy_file_to_device(exec, path.string(), file_offset, device_id::d1, tgt_layout, 8192);
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, source_layout));
+	std::filesystem::remove(path);
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "strided device layouts can be sent through shared memory transports", "[executor][transport]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 8, 24, 1000, 64};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	// chunks end within the fragments of the target, which have a different length than those of the source
+	const data_layout tgt_layout{tgt_buffer, 16, 40, 600, 96};
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+
+	// both sides would be separate processes with their own executors, sending from one of their devices to one of the other's
+	const auto name = "/copylib-backend-test-" + std::to_string(getpid());
+	shm_transport receiver(name, 4, 4096);
+	exec.pin_host_buffer(receiver.get_slot_memory(), receiver.get_slot_memory_size());
+	std::thread sender_thread([&] {
+		shm_transport sender(name);
+		exec.pin_host_buffer(sender.get_slot_memory(), sender.get_slot_memory_size());
+		copy_device_to_transport(exec, device_id::d0, src_layout, sender);
+		exec.unpin_host_buffer(sender.get_slot_memory());
+	});
+	copy_transport_to_device(exec, receiver, device_id::d1, tgt_layout);
+	sender_thread.join();
+	exec.unpin_host_buffer(receiver.get_slot_memory());
+
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "copy sets can be executed asynchronously", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 0, 16, 128, 32};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, src_layout};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+	const copy_strategy strat{copy_type::staged, copy_properties::use_kernel, d2d_implementation::host_staging_at_source, 256};
+	auto copy_set = manifest_strategy(spec, strat, basic_staging_provider{});
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+
+	std::atomic<bool> continued = false;
+	const auto handle = execute_copy_async(exec, copy_set);
+	handle.then([&] { continued = true; });
+	const auto evt = handle.get_event(device_id::d1);
+	CHECK(evt.has_value());
+	CHECK(!handle.get_event(device_id::host).has_value());
+	handle.wait();
+	CHECK(handle.test());
+	CHECK(continued);
+
+	// continuations registered after completion run immediately
+	bool continued_after = false;
+	handle.then([&] { continued_after = true; });
+	CHECK(continued_after);
+
+	CHECK(copy_handle{}.test());
+
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "recorded copy sets can be replayed on other buffers", "[executor]") {
+	const auto src_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{src_buffer, 0, 16, 128, 32};
+	const auto tgt_buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d1));
+	const data_layout tgt_layout{tgt_buffer, src_layout};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+	const copy_strategy strat{copy_type::staged, copy_properties::use_kernel, d2d_implementation::host_staging_at_source, 256};
+	const auto graph = record(exec, manifest_strategy(spec, strat, basic_staging_provider{}));
+	REQUIRE(graph.get_base_pointers() == std::vector<intptr_t>{src_buffer, tgt_buffer});
+
+	fill_source(exec, device_id::d0, src_buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d1, tgt_buffer, buffer_size, 66);
+	for(int i = 0; i < 3; i++) {
+		replay(graph);
+	}
+	CHECK(validate_target(exec, device_id::d1, tgt_buffer, tgt_layout, src_layout));
+
+	// the second halves of the buffers
+	const auto other_src_buffer = src_buffer + buffer_size;
+	const auto other_tgt_buffer = tgt_buffer + buffer_size;
+	const data_layout other_src_layout{other_src_buffer, src_layout};
+	const data_layout other_tgt_layout{other_tgt_buffer, tgt_layout};
+	fill_source(exec, device_id::d0, other_src_buffer, buffer_size, other_src_layout, 42);
+	fill_uniform(exec, device_id::d1, other_tgt_buffer, buffer_size, 66);
+	replay(graph, {other_src_buffer, other_tgt_buffer});
+	CHECK(validate_target(exec, device_id::d1, other_tgt_buffer, other_tgt_layout, other_src_layout));
+
+	replay(copy_graph{}); // nothing to do
+}
+
+TEST_CASE_PERSISTENT_FIXTURE(ExecutorFixture, "recorded copy sets within a device can be replayed concurrently", "[executor]") {
+	// within a single device and without host steps, replays submit a command graph where the implementation supports it
+	const auto buffer = reinterpret_cast<intptr_t>(exec.get_buffer(device_id::d0));
+	const data_layout src_layout{buffer, 0, 16, 128, 32};
+	const auto tgt_buffer = buffer + buffer_size;
+	const data_layout tgt_layout{tgt_buffer, 0, 16, 128, 48};
+	const auto spec = copy_spec{device_id::d0, src_layout, device_id::d0, tgt_layout};
+	const copy_strategy strat{copy_type::direct, copy_properties::use_kernel, 256};
+	const auto graph = record(exec, manifest_strategy(spec, strat, basic_staging_provider{}));
+#if SYCL_EXT_ONEAPI_GRAPH
+	CHECK(graph.uses_command_graph());
+#endif
+
+	fill_source(exec, device_id::d0, buffer, buffer_size, src_layout, 42);
+	fill_uniform(exec, device_id::d0, tgt_buffer, buffer_size, 66);
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 4; t++) {
+		threads.emplace_back([&graph] {
+			for(int i = 0; i < 3; i++) {
+				replay(graph);
+			}
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	CHECK(validate_target(exec, device_id::d0, tgt_buffer, tgt_layout, src_layout));
+}
@@ -4,6 +4,9 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators_range.hpp>
 
+#include <bit>
+#include <limits>
+
 using namespace copylib;
 
 TEST_CASE("data layout validation", "[validation]") {
@@ -253,6 +256,27 @@ TEST_CASE("chunking 2D operations, different fragment length", "[chunking]") {
 	}
 }
 
+TEST_CASE("chunking 2D operations with a contiguous side", "[chunking]") {
+	const data_layout strided{0, 32, 16, 1024, 64};
+	const data_layout contiguous{1 << 20, 0, 16 * 1024};
+	const int64_t chunk_size = GENERATE(1024, 4096 - 16);
+	CAPTURE(chunk_size);
+
+	SECTION("contiguous source") {
+		const copy_spec spec{device_id::host, contiguous, device_id::d0, strided};
+		const auto copy_set = apply_chunking(spec, copy_strategy{chunk_size});
+		CHECK(is_equivalent(copy_set, spec));
+		// the tail chunk is smaller than the others
+		CHECK(copy_set.back().front().source_layout.total_bytes() == copy_set.back().front().target_layout.total_bytes());
+	}
+	SECTION("contiguous target") {
+		const copy_spec spec{device_id::d0, strided, device_id::host, contiguous};
+		const auto copy_set = apply_chunking(spec, copy_strategy{chunk_size});
+		CHECK(is_equivalent(copy_set, spec));
+		CHECK(copy_set.back().front().source_layout.total_bytes() == copy_set.back().front().target_layout.total_bytes());
+	}
+}
+
 staging_id test_staging_buffer_provider(device_id did, bool on_host, int64_t) { return {on_host, did, 42}; }
 
 TEST_CASE("staging copy specs at the source end", "[staging]") {
@@ -457,6 +481,92 @@ TEST_CASE("Applying d2d implementations to staged plans", "[d2d]") {
 	}
 }
 
+TEST_CASE("compressing host staging of d2d copies", "[d2d]") {
+	const data_layout src_layout{0x10000, 0, 16, 64, 128};
+	const data_layout tgt_layout{0x20000, 0, 16, 64, 128};
+	const copy_spec spec{device_id::d0, src_layout, device_id::d1, tgt_layout};
+	const d2d_implementation impl = GENERATE(d2d_implementation::host_staging_at_source, d2d_implementation::host_staging_at_target);
+	CAPTURE(impl);
+
+	SECTION("only contiguous transfers through host staging at one end are compressed") {
+		const copy_strategy strategy{copy_type::staged, copy_properties::use_kernel | copy_properties::use_compression, impl};
+		std::vector<int64_t> staging_sizes;
+		const staging_buffer_provider provider = [&, basic = basic_staging_provider{}](device_id did, bool on_host, int64_t size) mutable {
+			if(on_host) { staging_sizes.push_back(size); }
+			return basic(did, on_host, size);
+		};
+		const auto copy_set = manifest_strategy(spec, strategy, provider);
+		CHECK(is_valid(copy_set));
+		CHECK(is_equivalent(copy_set, spec));
+		REQUIRE(copy_set.size() == 1);
+		const auto& plan = copy_set.front();
+		REQUIRE(plan.size() == 4);
+		CHECK(!(plan[0].properties & copy_properties::use_compression));
+		CHECK(plan[1].properties & copy_properties::use_compression);
+		CHECK(plan[1].target_device == device_id::host);
+		CHECK(plan[2].properties & copy_properties::use_compression);
+		CHECK(plan[2].source_device == device_id::host);
+		CHECK(!(plan[3].properties & copy_properties::use_compression));
+		// the staged data follows the header, within the extent of the staged layout
+		CHECK(staging_sizes == std::vector<int64_t>{compressed_staging_header_size + src_layout.total_bytes()});
+		CHECK(plan[1].target_layout.offset == compressed_staging_header_size);
+		CHECK(plan[1].target_layout.total_extent() == staging_sizes.front());
+		CHECK(plan[2].source_layout == plan[1].target_layout);
+	}
+	SECTION("strided transfers are not compressed") {
+		const auto copy_plan = apply_d2d_implementation({spec}, impl, basic_staging_provider{}, true);
+		REQUIRE(copy_plan.size() == 2);
+		CHECK(!(copy_plan[0].properties & copy_properties::use_compression));
+		CHECK(!(copy_plan[1].properties & copy_properties::use_compression));
+	}
+	SECTION("compressed copies are between device and host") {
+		const copy_spec contiguous{device_id::d0, {0x10000, 0, 1024}, device_id::host, {0x20000, 0, 1024}, copy_properties::use_compression};
+		CHECK(is_valid(contiguous));
+		CHECK(!is_valid(copy_spec{device_id::d0, {0x10000, 0, 1024}, device_id::d1, {0x20000, 0, 1024}, copy_properties::use_compression}));
+		CHECK(!is_valid(copy_spec{device_id::d0, src_layout, device_id::host, tgt_layout, copy_properties::use_compression}));
+	}
+}
+
+TEST_CASE("bouncing pageable host memory through pinned staging", "[bouncing]") {
+	const data_layout host_layout{0, 0, 16, 64, 128};
+	const data_layout device_layout{0, 0, 1024};
+	const auto all_pageable = [](const data_layout&) { return true; };
+	const auto none_pageable = [](const data_layout&) { return false; };
+	const staging_id expected_staging{true, device_id::d0, 42};
+	const data_layout expected_staged_layout{expected_staging, 0, 1024, 1, 1024};
+
+	SECTION("host to device") {
+		const copy_spec spec{device_id::host, host_layout, device_id::d0, device_layout};
+		const auto plan = apply_host_bouncing(copy_plan{spec}, all_pageable, test_staging_buffer_provider);
+		REQUIRE(plan.size() == 2);
+		CHECK(plan.front() == copy_spec{device_id::host, host_layout, device_id::host, expected_staged_layout});
+		CHECK(plan.back() == copy_spec{device_id::host, expected_staged_layout, device_id::d0, device_layout});
+		CHECK(is_equivalent(plan, spec));
+	}
+	SECTION("device to host") {
+		const copy_spec spec{device_id::d0, device_layout, device_id::host, host_layout};
+		const auto plan = apply_host_bouncing(copy_plan{spec}, all_pageable, test_staging_buffer_provider);
+		REQUIRE(plan.size() == 2);
+		CHECK(plan.front() == copy_spec{device_id::d0, device_layout, device_id::host, expected_staged_layout});
+		CHECK(plan.back() == copy_spec{device_id::host, expected_staged_layout, device_id::host, host_layout});
+		CHECK(is_equivalent(plan, spec));
+	}
+	SECTION("pinned host memory is not bounced") {
+		const copy_spec spec{device_id::host, host_layout, device_id::d0, device_layout};
+		const auto plan = apply_host_bouncing(copy_plan{spec}, none_pageable, test_staging_buffer_provider);
+		REQUIRE(plan.size() == 1);
+		CHECK(plan.front() == spec);
+	}
+	SECTION("h2h, d2d and already staged copies are not bounced") {
+		const auto staged_plan = apply_staging(copy_spec{device_id::d0, host_layout, device_id::d1, host_layout}, copy_strategy{copy_type::staged},
+		    test_staging_buffer_provider);
+		const auto plan = apply_host_bouncing(staged_plan, all_pageable, test_staging_buffer_provider);
+		CHECK(plan == staged_plan);
+		const copy_spec h2h{device_id::host, host_layout, device_id::host, data_layout{1 << 20, 0, 1024}};
+		CHECK(apply_host_bouncing(copy_plan{h2h}, all_pageable, test_staging_buffer_provider) == copy_plan{h2h});
+	}
+}
+
 TEST_CASE("implementing copy strategies", "[copy]") {
 	const data_layout source_layout{0x10000, 0x42, 16, 1024, 4096};
 	const int frag_size_multiplier = GENERATE(1, 2);
@@ -538,3 +648,227 @@ TEST_CASE("implementing copy strategies", "[copy]") {
 		CHECK(verify_properties(copy_set));
 	}
 }
+
+TEST_CASE("copies between devices beyond the first eight", "[copy]") {
+	const auto src_device = make_device_id(9);
+	const auto tgt_device = make_device_id(17);
+	const copy_spec spec{src_device, {0x10000, 0x42, 16, 1024, 4096}, tgt_device, {0x20000, 0x0, 32, 512, 3084}};
+	const copy_strategy strategy{copy_type::staged, copy_properties::none, d2d_implementation::host_staging_at_both, 512};
+	const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+	CHECK(is_equivalent(copy_set, spec));
+	for(const auto& plan : copy_set) {
+		for(const auto& copy : plan) {
+			CHECK((copy.source_device == src_device || copy.source_device == tgt_device || copy.source_device == device_id::host));
+			CHECK((copy.target_device == src_device || copy.target_device == tgt_device || copy.target_device == device_id::host));
+			for(const auto& layout : {copy.source_layout, copy.target_layout}) {
+				if(layout.is_unplaced_staging()) { CHECK((layout.staging.did == src_device || layout.staging.did == tgt_device)); }
+			}
+		}
+	}
+}
+
+TEST_CASE("copies within a device are performed directly by kernels", "[copy]") {
+	const data_layout source_layout{0x10000, 0x40, 16, 1024, 4096};
+	const int64_t target_frag_length = GENERATE(16, 32, 24);
+	CAPTURE(target_frag_length);
+	const data_layout target_layout{0x1000000, 0x0, target_frag_length, 16 * 1024 / target_frag_length, 3072};
+	const copy_spec spec{device_id::d0, source_layout, device_id::d0, target_layout};
+	const bool compatible = target_frag_length % 16 == 0;
+
+	const int64_t chunk_size = GENERATE(0, 512);
+	CAPTURE(chunk_size);
+
+	SECTION("with kernels, compatible layouts are not staged") {
+		const copy_strategy strategy{copy_type::staged, copy_properties::use_kernel, chunk_size};
+		CHECK(is_direct_kernel_copy(spec, strategy) == compatible);
+		if(!compatible) { return; }
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		CHECK(is_equivalent(copy_set, spec));
+		for(const auto& plan : copy_set) {
+			REQUIRE(plan.size() == 1);
+			CHECK(plan.front().properties == copy_properties::use_kernel);
+		}
+	}
+	SECTION("without kernels, copies are staged") {
+		const copy_strategy strategy{copy_type::staged, copy_properties::none, chunk_size};
+		CHECK(!is_direct_kernel_copy(spec, strategy));
+		if(!compatible) { return; }
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		CHECK(is_equivalent(copy_set, spec));
+		CHECK(copy_set.front().size() == 3);
+	}
+	SECTION("copies between devices are staged") {
+		const copy_spec d2d_spec{device_id::d0, source_layout, device_id::d1, target_layout};
+		CHECK(!is_direct_kernel_copy(d2d_spec, copy_strategy{copy_type::staged, copy_properties::use_kernel, chunk_size}));
+	}
+}
+
+TEST_CASE("converting element bit patterns", "[conversion]") {
+	const auto bits = [](float f) { return std::bit_cast<uint32_t>(f); };
+	CHECK(fp32_to_fp16_bits(bits(1.0f)) == 0x3c00);
+	CHECK(fp32_to_fp16_bits(bits(-2.0f)) == 0xc000);
+	CHECK(fp32_to_fp16_bits(bits(65504.0f)) == 0x7bff);
+	CHECK(fp32_to_fp16_bits(bits(65519.0f)) == 0x7bff);
+	CHECK(fp32_to_fp16_bits(bits(65520.0f)) == 0x7c00);
+	CHECK(fp32_to_fp16_bits(bits(std::numeric_limits<float>::infinity())) == 0x7c00);
+	CHECK((fp32_to_fp16_bits(bits(std::numeric_limits<float>::quiet_NaN())) & 0x7fff) > 0x7c00);
+	// ties round to even
+	CHECK(fp32_to_fp16_bits(bits(1.0f + 0x1p-11f)) == 0x3c00);
+	CHECK(fp32_to_fp16_bits(bits(1.0f + 3 * 0x1p-11f)) == 0x3c02);
+	// subnormals
+	CHECK(fp32_to_fp16_bits(bits(0x1p-24f)) == 0x0001);
+	CHECK(fp32_to_fp16_bits(bits(0x1p-25f)) == 0x0000);
+	CHECK(fp32_to_fp16_bits(bits(0x1.8p-25f)) == 0x0001);
+	CHECK(fp32_to_fp16_bits(bits(0x1.ff8p-15f)) == 0x03ff);
+	CHECK(fp32_to_fp16_bits(bits(0x1.ffcp-15f)) == 0x0400);
+
+	CHECK(fp32_to_bf16_bits(bits(1.0f)) == 0x3f80);
+	CHECK(fp32_to_bf16_bits(bits(1.0f + 0x1p-8f)) == 0x3f80);
+	CHECK(fp32_to_bf16_bits(bits(1.0f + 3 * 0x1p-8f)) == 0x3f82);
+	CHECK((fp32_to_bf16_bits(bits(std::numeric_limits<float>::quiet_NaN())) & 0x7fff) > 0x7f80);
+	CHECK(bf16_to_fp32_bits(0x3f80) == bits(1.0f));
+
+	// every fp16 value is exactly representable in fp32, and converts back to itself
+	for(uint32_t h = 0; h <= 0xffff; h++) {
+		if((h & 0x7fff) > 0x7c00) { continue; } // nan
+		CAPTURE(h);
+		const auto f = fp16_to_fp32_bits(static_cast<uint16_t>(h));
+		REQUIRE(fp32_to_fp16_bits(f) == h);
+	}
+	CHECK(fp16_to_fp32_bits(0x0001) == bits(0x1p-24f));
+	CHECK(fp16_to_fp32_bits(0x8400) == bits(-0x1p-14f));
+}
+
+TEST_CASE("copies with element conversions", "[conversion]") {
+	const data_layout wide_layout{0x10000, 0x40, 16, 256, 1024};
+	const data_layout narrow_layout{0x1000000, 0x0, 8 * 256};
+
+	SECTION("conversions change the size of the target") {
+		CHECK(is_valid(copy_spec{device_id::d0, wide_layout, device_id::d1, narrow_layout, copy_properties::none, element_conversion::fp32_to_fp16}));
+		CHECK(!is_valid(copy_spec{device_id::d0, wide_layout, device_id::d1, narrow_layout}));
+		CHECK(!is_valid(copy_spec{device_id::d0, narrow_layout, device_id::d1, wide_layout, copy_properties::none, element_conversion::fp32_to_fp16}));
+		CHECK(is_valid(copy_spec{device_id::d0, narrow_layout, device_id::d1, wide_layout, copy_properties::none, element_conversion::bf16_to_fp32}));
+		// elements can not be split
+		CHECK(!is_valid(copy_spec{device_id::d0, {0, 0, 6, 2, 8}, device_id::d1, {0, 0, 6}, copy_properties::none, element_conversion::fp32_to_fp16}));
+	}
+
+	const int64_t chunk_size = GENERATE(0, 1024, 1000);
+	CAPTURE(chunk_size);
+	const copy_strategy strategy{copy_type::staged, copy_properties::use_kernel, chunk_size};
+
+	SECTION("narrowing happens on the source device, while linearizing") {
+		const copy_spec spec{device_id::d0, wide_layout, device_id::d1, narrow_layout, copy_properties::none, element_conversion::fp32_to_fp16};
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		CHECK(is_valid(copy_set));
+		CHECK(is_equivalent(copy_set, spec));
+		for(const auto& plan : copy_set) {
+			REQUIRE(plan.size() == 2);
+			CHECK(plan[0].source_device == device_id::d0);
+			CHECK(plan[0].target_device == device_id::d0);
+			CHECK(plan[0].conversion == element_conversion::fp32_to_fp16);
+			CHECK(plan[0].properties == copy_properties::use_kernel);
+			CHECK(plan[1].conversion == element_conversion::none);
+			CHECK(plan[1].source_layout.total_bytes() * 2 == plan[0].source_layout.total_bytes());
+		}
+	}
+	SECTION("widening happens on the target device, while unstaging") {
+		const copy_spec spec{device_id::d1, narrow_layout, device_id::d0, wide_layout, copy_properties::none, element_conversion::fp16_to_fp32};
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		CHECK(is_valid(copy_set));
+		CHECK(is_equivalent(copy_set, spec));
+		for(const auto& plan : copy_set) {
+			REQUIRE(plan.size() == 2);
+			CHECK(plan[0].conversion == element_conversion::none);
+			CHECK(plan[0].target_layout.total_bytes() * 2 == plan[1].target_layout.total_bytes());
+			CHECK(plan[1].source_device == device_id::d0);
+			CHECK(plan[1].target_device == device_id::d0);
+			CHECK(plan[1].conversion == element_conversion::fp16_to_fp32);
+		}
+	}
+	SECTION("narrowing from the host happens on the target device") {
+		const copy_spec spec{device_id::host, wide_layout, device_id::d1, narrow_layout, copy_properties::none, element_conversion::fp32_to_bf16};
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		CHECK(is_valid(copy_set));
+		CHECK(is_equivalent(copy_set, spec));
+		for(const auto& plan : copy_set) {
+			REQUIRE(plan.size() == 3);
+			CHECK(plan[0].source_device == device_id::host);
+			CHECK(plan[2].target_device == device_id::d1);
+			CHECK(plan[2].conversion == element_conversion::fp32_to_bf16);
+		}
+	}
+	SECTION("conversions within a device are a single kernel") {
+		const copy_spec spec{device_id::d0, wide_layout, device_id::d0, narrow_layout, copy_properties::none, element_conversion::fp32_to_fp16};
+		const auto copy_set = manifest_strategy(spec, strategy, basic_staging_provider{});
+		REQUIRE(copy_set.size() == 1);
+		REQUIRE(copy_set.front().size() == 1);
+		CHECK(copy_set.front().front() == spec.with_properties(copy_properties::use_kernel));
+	}
+}
+
+TEST_CASE("estimating the cost of copy plans", "[partition]") {
+	const copy_spec small{device_id::d0, {0, 0, 1024}, device_id::d1, {0, 0, 1024}};
+	const copy_spec large{device_id::d0, {0, 0, 1024 * 1024}, device_id::d1, {0, 0, 1024 * 1024}};
+	CHECK(estimate_cost({small}) < estimate_cost({large}));
+	// more hops are more expensive
+	const copy_spec small_hop{device_id::d1, {0, 0, 1024}, device_id::d1, {0, 2048, 1024}};
+	CHECK(estimate_cost({small}) < estimate_cost({small, small_hop}));
+	// the same number of bytes is more expensive in many individual fragments, unless a kernel is used
+	const copy_spec strided{device_id::d0, {0, 0, 16, 64, 128}, device_id::d1, {0, 0, 1024}};
+	CHECK(estimate_cost({small}) < estimate_cost({strided}));
+	CHECK(estimate_cost({strided.with_properties(copy_properties::use_kernel)}) < estimate_cost({strided}));
+	// or the fragments are packed on the host
+	const copy_spec host_packed{device_id::host, {0, 0, 16, 64, 128}, device_id::host, {0, 0, 1024}};
+	CHECK(estimate_cost({host_packed}) < estimate_cost({strided}));
+}
+
+TEST_CASE("partitioning copy sets by cost", "[partition]") {
+	const auto plan_of_size = [](int64_t bytes) { return copy_plan{{device_id::d0, {0, 0, bytes}, device_id::d1, {0, 0, bytes}}}; };
+
+	SECTION("uniform plans are distributed evenly") {
+		const parallel_copy_set set(8, plan_of_size(1024));
+		const auto partition = partition_by_cost(set, 4);
+		REQUIRE(partition.parts.size() == 4);
+		for(const auto& part : partition.parts) {
+			CHECK(part.size() == 2);
+		}
+		CHECK(partition.imbalance() == 1.0);
+	}
+
+	SECTION("each plan is assigned exactly once") {
+		parallel_copy_set set;
+		for(int64_t i = 1; i <= 13; i++) {
+			set.push_back(plan_of_size(i * 1000));
+		}
+		const auto partition = partition_by_cost(set, 3);
+		std::vector<size_t> assigned;
+		for(const auto& part : partition.parts) {
+			assigned.insert(assigned.end(), part.begin(), part.end());
+		}
+		std::ranges::sort(assigned);
+		CHECK(assigned == std::vector<size_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12});
+	}
+
+	SECTION("a single large plan is not grouped with others") {
+		parallel_copy_set set{plan_of_size(16 * 1024 * 1024)};
+		for(int64_t i = 0; i < 6; i++) {
+			set.push_back(plan_of_size(1024 * 1024));
+		}
+		const auto partition = partition_by_cost(set, 2);
+		const auto& large_part = std::ranges::find(partition.parts[0], 0) != partition.parts[0].end() ? partition.parts[0] : partition.parts[1];
+		CHECK(large_part.size() == 1);
+		CHECK(partition.imbalance() > 1.0);
+		// a plan count based split would put 4 plans (including the large one) in one part
+		CHECK(partition.imbalance() < 2.0);
+	}
+
+	SECTION("more parts than plans") {
+		const parallel_copy_set set(2, plan_of_size(1024));
+		const auto partition = partition_by_cost(set, 4);
+		CHECK(partition.parts[0].size() == 1);
+		CHECK(partition.parts[1].size() == 1);
+		CHECK(partition.parts[2].empty());
+		CHECK(partition.parts[3].empty());
+		CHECK(partition.imbalance() == 2.0);
+	}
+}
@@ -0,0 +1,163 @@
+#include "copylib_host.hpp"
+#include "test_utils.hpp" // IWYU pragma: keep
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_range.hpp>
+
+#include <cstring>
+#include <memory>
+#include <numeric>
+
+using namespace copylib;
+
+namespace {
+// fill a buffer with a pattern that differs at each byte position (modulo 251, to avoid aligning with power of two strides)
+std::vector<uint8_t> make_pattern(size_t size) {
+	std::vector<uint8_t> data(size);
+	for(size_t i = 0; i < size; i++) {
+		data[i] = static_cast<uint8_t>(i % 251);
+	}
+	return data;
+}
+
+// check that exactly the target layout was written, with the bytes of the source layout in order
+bool check_copy(const std::vector<uint8_t>& src, const data_layout& src_layout, const std::vector<uint8_t>& tgt, const data_layout& tgt_layout) {
+	std::vector<uint8_t> expected(tgt.size(), 0x66);
+	std::vector<uint8_t> linear;
+	for(int64_t f = 0; f < src_layout.fragment_count; f++) {
+		const auto start = src.begin() + src_layout.fragment_offset(f);
+		linear.insert(linear.end(), start, start + src_layout.fragment_length);
+	}
+	for(int64_t f = 0; f < tgt_layout.fragment_count; f++) {
+		std::copy_n(linear.begin() + f * tgt_layout.fragment_length, tgt_layout.fragment_length, expected.begin() + tgt_layout.fragment_offset(f));
+	}
+	return expected == tgt;
+}
+} // namespace
+
+TEST_CASE("NUMA node information is available", "[host]") {
+	const auto nodes = get_numa_node_cpus();
+	REQUIRE(!nodes.empty());
+	CHECK(std::ranges::any_of(nodes, [](const auto& cpus) { return !cpus.empty(); }));
+}
+
+TEST_CASE("CPU lists are parsed and formatted in the sysfs format", "[host]") {
+	CHECK(parse_cpu_list("0-3,8-11\n") == std::vector<int>{0, 1, 2, 3, 8, 9, 10, 11});
+	CHECK(parse_cpu_list("5") == std::vector<int>{5});
+	CHECK(parse_cpu_list("").empty());
+	CHECK(format_cpu_list({0, 1, 2, 3, 8, 9, 10, 11}) == "0-3,8-11");
+	CHECK(format_cpu_list({1, 3, 4}) == "1,3-4");
+	CHECK(format_cpu_list({}).empty());
+}
+
+TEST_CASE("PCI device locality is unknown for devices which do not exist", "[host]") {
+	const auto locality = get_pci_device_locality("ffff:ff:1f.7");
+	CHECK(locality.pci_address.empty());
+	CHECK(locality.numa_node == -1);
+	CHECK(locality.local_cpus.empty());
+	CHECK(get_pci_device_locality("").pci_address.empty());
+}
+
+TEST_CASE("host memory can be bound to a NUMA node", "[host]") {
+	const int node = std::max(0, get_numa_node_of_cpu(0));
+	constexpr int64_t size = 4 * 1024 * 1024;
+	auto buffer = std::make_unique<std::byte[]>(size);
+	// binding may be unavailable (e.g. in containers); placement can only be verified if it succeeded
+	if(bind_to_numa_node(buffer.get(), size, node)) {
+		std::memset(buffer.get(), 1, size);
+		CHECK(get_fraction_on_numa_node(buffer.get(), size, node) == 1.0);
+	}
+	CHECK(get_fraction_on_numa_node(buffer.get(), size, node, 0) == 0.0);
+}
+
+TEST_CASE("buffers are initialized in parallel", "[host]") {
+	host_copy_engine engine(4);
+	const int64_t size = GENERATE(int64_t{1000}, int64_t{3 * 1024 * 1024 + 17});
+	const auto init = GENERATE(buffer_init::none, buffer_init::first_touch, buffer_init::pattern);
+	const int numa_node = GENERATE(-1, get_numa_node_of_cpu(0));
+	CAPTURE(size, numa_node);
+	std::vector<uint8_t> buffer(size, 0x66);
+	engine.initialize(reinterpret_cast<std::byte*>(buffer.data()), size, init, numa_node);
+	bool ok = true;
+	for(int64_t i = 0; i < size; i++) {
+		const uint8_t expected = init == buffer_init::none ? 0x66 : init == buffer_init::first_touch ? 0 : static_cast<uint8_t>(i % 256);
+		ok &= buffer[i] == expected;
+	}
+	CHECK(ok);
+}
+
+TEST_CASE("non-temporal copies are correct for any alignment and length", "[host]") {
+	const auto src = make_pattern(4096);
+	const int64_t src_offset = GENERATE(0, 1, 13);
+	const int64_t tgt_offset = GENERATE(0, 7, 16);
+	const int64_t length = GENERATE(0, 5, 64, 1000, 3000);
+	CAPTURE(src_offset, tgt_offset, length);
+	std::vector<uint8_t> tgt(4096, 0x66);
+	memcpy_non_temporal(reinterpret_cast<std::byte*>(tgt.data() + tgt_offset), reinterpret_cast<const std::byte*>(src.data() + src_offset), length);
+	non_temporal_fence();
+	CHECK(std::equal(src.begin() + src_offset, src.begin() + src_offset + length, tgt.begin() + tgt_offset));
+	CHECK(std::all_of(tgt.begin(), tgt.begin() + tgt_offset, [](uint8_t v) { return v == 0x66; }));
+	CHECK(std::all_of(tgt.begin() + tgt_offset + length, tgt.end(), [](uint8_t v) { return v == 0x66; }));
+}
+
+TEST_CASE("strided fragments are packed and unpacked correctly at each SIMD level", "[host]") {
+	const auto level = GENERATE(host_simd_level::scalar, host_simd_level::avx2, host_simd_level::avx512);
+	if(level > get_host_simd_level()) { return; } // not supported on this CPU
+	const int64_t fragment_length = GENERATE(1, 3, 4, 8, 16, 24, 32, 100);
+	const int64_t gap = GENERATE(0, 4, 20);
+	const int64_t count = GENERATE(1, 7, 17, 1001);
+	CAPTURE(get_host_simd_level_name(level), fragment_length, gap, count);
+	const auto stride = fragment_length + gap;
+
+	const auto strided = make_pattern(stride * count + 8);
+	std::vector<uint8_t> linear(fragment_length * count + 8, 0x66);
+	pack_fragments(reinterpret_cast<std::byte*>(linear.data()), reinterpret_cast<const std::byte*>(strided.data() + 3), fragment_length, stride, count, level);
+	bool packed_ok = true;
+	for(int64_t i = 0; i < count; i++) {
+		packed_ok &= std::equal(linear.begin() + i * fragment_length, linear.begin() + (i + 1) * fragment_length, strided.begin() + 3 + i * stride);
+	}
+	CHECK(packed_ok);
+	CHECK(std::all_of(linear.begin() + fragment_length * count, linear.end(), [](uint8_t v) { return v == 0x66; }));
+
+	std::vector<uint8_t> unpacked(strided.size(), 0x66);
+	unpack_fragments(reinterpret_cast<std::byte*>(unpacked.data() + 3), reinterpret_cast<const std::byte*>(linear.data()), fragment_length, stride, count, level);
+	bool unpacked_ok = true;
+	for(int64_t i = 0; i < static_cast<int64_t>(unpacked.size()); i++) {
+		const bool in_fragment = i >= 3 && (i - 3) < stride * count && (i - 3) % stride < fragment_length;
+		unpacked_ok &= unpacked[i] == (in_fragment ? strided[i] : 0x66);
+	}
+	CHECK(unpacked_ok);
+}
+
+TEST_CASE("host copy engine performs small and large copies", "[host]") {
+	host_copy_engine engine(4);
+	CHECK(engine.get_thread_count() >= 1);
+	CHECK(engine.get_numa_node_count() >= 1);
+
+	constexpr int64_t buffer_size = 48 * 1024 * 1024;
+	const auto src = make_pattern(buffer_size);
+	std::vector<uint8_t> tgt(buffer_size);
+	const auto src_base = reinterpret_cast<intptr_t>(src.data());
+	const auto tgt_base = reinterpret_cast<intptr_t>(tgt.data());
+
+	const auto check = [&](const data_layout& src_layout, const data_layout& tgt_layout) {
+		std::ranges::fill(tgt, 0x66);
+		const copy_spec spec{device_id::host, src_layout, device_id::host, tgt_layout};
+		REQUIRE(is_valid(spec));
+		engine.copy(spec);
+		CHECK(check_copy(src, src_layout, tgt, tgt_layout));
+	};
+
+	SECTION("small contiguous") { check({src_base, 3, 1000}, {tgt_base, 5, 1000}); }
+	SECTION("large contiguous") { check({src_base, 64, 5 * 1024 * 1024 + 3}, {tgt_base, 8, 5 * 1024 * 1024 + 3}); }
+	SECTION("large contiguous, non-temporal") { check({src_base, 1, 20 * 1024 * 1024}, {tgt_base, 3, 20 * 1024 * 1024}); }
+	SECTION("large strided to strided") { check({src_base, 16, 48, 64 * 1024, 96}, {tgt_base, 0, 48, 64 * 1024, 64}); }
+	SECTION("large strided to strided, non-temporal") { check({src_base, 0, 8192, 2560, 16384}, {tgt_base, 8, 8192, 2560, 9000}); }
+	SECTION("large, short fragments to contiguous, without non-temporal stores") { check({src_base, 4, 512, 40 * 1024, 1024}, {tgt_base, 0, 512 * 40 * 1024}); }
+	SECTION("large strided to contiguous") { check({src_base, 0, 32, 128 * 1024, 128}, {tgt_base, 32, 32 * 128 * 1024}); }
+	SECTION("small fragments to contiguous") { check({src_base, 4, 8, 64, 24}, {tgt_base, 0, 8 * 64}); }
+	SECTION("contiguous to small fragments") { check({src_base, 4, 4 * 100}, {tgt_base, 12, 4, 100, 12}); }
+	SECTION("large, small fragments to contiguous") { check({src_base, 0, 8, 1024 * 1024, 24}, {tgt_base, 8, 8 * 1024 * 1024}); }
+	SECTION("large, contiguous to small fragments") { check({src_base, 8, 4 * 1024 * 1024}, {tgt_base, 0, 4, 1024 * 1024, 20}); }
+	SECTION("large, different fragment lengths") { check({src_base, 0, 64, 64 * 1024, 256}, {tgt_base, 0, 16, 256 * 1024, 32}); }
+}
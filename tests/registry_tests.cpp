@@ -0,0 +1,54 @@
+#include "copylib_registry.hpp"
+#include "copylib_support.hpp" // IWYU pragma: keep
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace copylib;
+
+TEST_CASE("buffer registry finds the buffer containing an address", "[registry]") {
+	buffer_registry registry;
+	registry.add({0x1000, 0x1000, device_id::d0, memory_kind::device});
+	registry.add({0x3000, 0x800, device_id::host, memory_kind::host_pinned});
+	registry.add({0x2000, 0x1000, device_id::host, memory_kind::host_pageable}); // adjacent on both sides
+	CHECK(registry.size() == 3);
+
+	CHECK(!registry.find(0xfff).has_value());
+	CHECK(registry.find(0x1000)->kind == memory_kind::device);
+	CHECK(registry.find(0x1fff)->kind == memory_kind::device);
+	CHECK(registry.find(0x2000)->kind == memory_kind::host_pageable);
+	CHECK(registry.find(0x3000)->did == device_id::host);
+	CHECK(registry.find(0x37ff)->kind == memory_kind::host_pinned);
+	CHECK(!registry.find(0x3800).has_value());
+
+	registry.remove(0x2000);
+	CHECK(registry.size() == 2);
+	CHECK(!registry.find(0x2800).has_value());
+	CHECK(registry.find(0x1800).has_value());
+}
+
+TEST_CASE("copy specs are checked against registered buffers", "[registry]") {
+	buffer_registry registry;
+	registry.add({0x10000, 0x1000, device_id::d0, memory_kind::device});
+	registry.add({0x20000, 0x1000, device_id::host, memory_kind::host_pinned});
+	registry.add({0x30000, 0x1000, device_id::d1, memory_kind::shared});
+
+	// within bounds, on the right side
+	CHECK(!check_against_registry(registry, {device_id::d0, {0x10000, 0, 0x1000}, device_id::host, {0x20000, 0, 0x1000}}).has_value());
+	CHECK(!check_against_registry(registry, {device_id::d0, {0x10000, 0x100, 16, 8, 64}, device_id::d1, {0x30000, 0, 128}}).has_value());
+	// device memory may be accessed from its peers
+	CHECK(!check_against_registry(registry, {device_id::d1, {0x10000, 0, 0x100}, device_id::d1, {0x30000, 0, 0x100}}).has_value());
+	// shared memory may be used from the host
+	CHECK(!check_against_registry(registry, {device_id::host, {0x30000, 0, 0x100}, device_id::host, {0x20000, 0, 0x100}}).has_value());
+	// unregistered memory can not be checked
+	CHECK(!check_against_registry(registry, {device_id::d0, {0x50000, 0, 0x100000}, device_id::host, {0x60000, 0, 0x100000}}).has_value());
+	// staging layouts are not placed yet
+	CHECK(!check_against_registry(registry, {device_id::d0, {staging_id{false, device_id::d0, 0}, 0, 0x100000}, device_id::host, {0x20000, 0, 0x100}})
+	           .has_value());
+
+	// out of bounds, contiguous and strided
+	CHECK(check_against_registry(registry, {device_id::d0, {0x10000, 0x800, 0x801}, device_id::host, {0x20000, 0, 0x801}}).has_value());
+	CHECK(check_against_registry(registry, {device_id::d0, {0x10000, 0, 16, 64, 128}, device_id::host, {0x20000, 0, 1024}}).has_value());
+	// device memory used as host memory, and vice versa
+	CHECK(check_against_registry(registry, {device_id::host, {0x10000, 0, 0x100}, device_id::host, {0x20000, 0, 0x100}}).has_value());
+	CHECK(check_against_registry(registry, {device_id::d0, {0x10000, 0, 0x100}, device_id::d0, {0x20000, 0, 0x100}}).has_value());
+}
@@ -0,0 +1,67 @@
+#include "copylib_scheduler.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <future>
+#include <set>
+
+using namespace copylib;
+
+TEST_CASE("work stealing scheduler executes all tasks", "[scheduler]") {
+	work_stealing_scheduler scheduler(4);
+	CHECK(scheduler.get_worker_count() == 4);
+
+	constexpr int64_t tasks_per_worker = 100;
+	std::atomic<int64_t> executed = 0;
+	std::promise<void> all_done;
+	std::vector<std::vector<work_stealing_scheduler::task>> tasks(4);
+	for(auto& worker_tasks : tasks) {
+		for(int64_t i = 0; i < tasks_per_worker; i++) {
+			worker_tasks.push_back([&](int64_t) {
+				if(++executed == 4 * tasks_per_worker) { all_done.set_value(); }
+			});
+		}
+	}
+	scheduler.submit(std::move(tasks));
+	all_done.get_future().wait();
+	CHECK(executed == 4 * tasks_per_worker);
+}
+
+TEST_CASE("work stealing scheduler balances tasks assigned to a single worker", "[scheduler]") {
+	using namespace std::chrono_literals;
+	work_stealing_scheduler scheduler(4);
+
+	constexpr int64_t num_tasks = 16;
+	std::mutex mutex;
+	std::set<int64_t> workers_used;
+	std::atomic<int64_t> executed = 0;
+	std::promise<void> all_done;
+	std::vector<std::vector<work_stealing_scheduler::task>> tasks(1);
+	for(int64_t i = 0; i < num_tasks; i++) {
+		tasks[0].push_back([&](int64_t worker_idx) {
+			std::this_thread::sleep_for(5ms);
+			{
+				std::lock_guard lock(mutex);
+				workers_used.insert(worker_idx);
+			}
+			if(++executed == num_tasks) { all_done.set_value(); }
+		});
+	}
+	scheduler.submit(std::move(tasks));
+	all_done.get_future().wait();
+	CHECK(executed == num_tasks);
+	CHECK(workers_used.size() > 1);
+	CHECK(scheduler.get_steal_count() > 0);
+}
+
+TEST_CASE("work stealing scheduler completes pending tasks on destruction", "[scheduler]") {
+	std::atomic<int64_t> executed = 0;
+	{
+		work_stealing_scheduler scheduler(2);
+		for(int64_t i = 0; i < 50; i++) {
+			scheduler.submit(i % 2, [&](int64_t) { executed++; });
+		}
+	}
+	CHECK(executed == 50);
+}
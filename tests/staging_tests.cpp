@@ -0,0 +1,120 @@
+#include "copylib_staging.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+using namespace copylib;
+
+namespace {
+bool overlap(const staging_region& a, const staging_region& b) {
+	if(a.did != b.did || a.on_host != b.on_host) { return false; }
+	return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+} // namespace
+
+TEST_CASE("staging size classes", "[staging]") {
+	const int64_t size = GENERATE(1, 100, 4096, 4097, 10000, 65536, 100000, 1234567, 64 * 1024 * 1024 + 1);
+	CAPTURE(size);
+	const auto cls = staging_pool::size_class(size);
+	CHECK(cls >= size);
+	CHECK(cls % staging_pool::granularity == 0);
+	CHECK(cls <= std::max(staging_pool::granularity, size + size / 8 + staging_pool::granularity));
+	CHECK(staging_pool::size_class(cls) == cls);
+}
+
+TEST_CASE("staging pool hands out disjoint regions and recycles them", "[staging]") {
+	constexpr int64_t buffer_size = 1024 * 1024;
+	std::vector<std::byte> dev_buffer(buffer_size), host_buffer(buffer_size);
+	staging_pool pool;
+	pool.add_buffer(device_id::d0, false, dev_buffer.data(), buffer_size);
+	pool.add_buffer(device_id::d0, true, host_buffer.data(), buffer_size);
+
+	const auto regions = pool.acquire({{device_id::d0, false, 1000}, {device_id::d0, false, 20000}, {device_id::d0, true, 1000}, {device_id::d0, false, 1000}});
+	REQUIRE(regions.size() == 4);
+	for(size_t i = 0; i < regions.size(); i++) {
+		CHECK(regions[i].offset % staging_pool::granularity == 0);
+		CHECK(regions[i].offset + regions[i].size <= buffer_size);
+		CHECK(regions[i].ptr == (regions[i].on_host ? host_buffer.data() : dev_buffer.data()) + regions[i].offset);
+		for(size_t j = i + 1; j < regions.size(); j++) {
+			CHECK(!overlap(regions[i], regions[j]));
+		}
+	}
+	CHECK(pool.get_allocated_bytes(device_id::d0, false) == regions[0].size + regions[1].size + regions[3].size);
+	CHECK(pool.get_allocated_bytes(device_id::d0, true) == regions[2].size);
+
+	SECTION("released regions are reused for requests of the same size class") {
+		pool.release({regions[1]});
+		const auto reused = pool.acquire({{device_id::d0, false, 19000}});
+		CHECK(reused[0].offset == regions[1].offset);
+		pool.release(reused);
+	}
+	SECTION("once all regions are released, the buffer is available in full") {
+		pool.release(regions);
+		CHECK(pool.get_allocated_bytes(device_id::d0, false) == 0);
+		const auto full = pool.acquire({{device_id::d0, false, buffer_size}});
+		CHECK(full[0].offset == 0);
+		pool.release(full);
+	}
+}
+
+TEST_CASE("staging pool only accepts requests which fit next to long-lived regions", "[staging]") {
+	constexpr int64_t buffer_size = 64 * 1024;
+	std::vector<std::byte> buffer(buffer_size);
+	staging_pool pool;
+	pool.add_buffer(device_id::d0, false, buffer.data(), buffer_size);
+
+	const auto long_lived = pool.acquire({{device_id::d0, false, 40 * 1024}}, true);
+	CHECK(long_lived[0].long_lived);
+	CHECK(pool.get_long_lived_bytes(device_id::d0, false) == long_lived[0].size);
+	CHECK(pool.is_satisfiable({{device_id::d0, false, 16 * 1024}}));
+	CHECK(!pool.is_satisfiable({{device_id::d0, false, 32 * 1024}}));
+	CHECK(!pool.is_satisfiable({{device_id::d0, false, 16 * 1024}, {device_id::d0, false, 16 * 1024}}));
+
+	// transient regions do not count against later requests, as they are eventually released
+	const auto transient = pool.acquire({{device_id::d0, false, 16 * 1024}});
+	CHECK(!transient[0].long_lived);
+	CHECK(pool.get_long_lived_bytes(device_id::d0, false) == long_lived[0].size);
+	CHECK(pool.is_satisfiable({{device_id::d0, false, 16 * 1024}}));
+	pool.release(transient);
+
+	pool.release(long_lived);
+	CHECK(pool.get_long_lived_bytes(device_id::d0, false) == 0);
+	CHECK(pool.is_satisfiable({{device_id::d0, false, buffer_size}}));
+}
+
+TEST_CASE("staging pool serves devices beyond the first eight", "[staging]") {
+	constexpr int64_t buffer_size = 64 * 1024;
+	std::vector<std::byte> low_buffer(buffer_size), high_buffer(buffer_size);
+	staging_pool pool;
+	pool.add_buffer(device_id::d1, false, low_buffer.data(), buffer_size);
+	pool.add_buffer(make_device_id(20), false, high_buffer.data(), buffer_size);
+
+	const auto regions = pool.acquire({{device_id::d1, false, 1000}, {make_device_id(20), false, 1000}});
+	REQUIRE(regions.size() == 2);
+	CHECK(regions[0].ptr == low_buffer.data() + regions[0].offset);
+	CHECK(regions[1].ptr == high_buffer.data() + regions[1].offset);
+	CHECK(pool.get_allocated_bytes(make_device_id(20), false) == regions[1].size);
+	pool.release(regions);
+	CHECK(pool.get_allocated_bytes(make_device_id(20), false) == 0);
+}
+
+TEST_CASE("staging pool blocks concurrent users until memory is released", "[staging]") {
+	using namespace std::chrono_literals;
+	constexpr int64_t buffer_size = 1024 * 1024;
+	std::vector<std::byte> buffer(buffer_size);
+	staging_pool pool;
+	pool.add_buffer(device_id::d1, false, buffer.data(), buffer_size);
+
+	const auto first = pool.acquire({{device_id::d1, false, buffer_size * 3 / 4}});
+	auto second = std::async(std::launch::async, [&] { return pool.acquire({{device_id::d1, false, buffer_size / 2}}); });
+	CHECK(second.wait_for(50ms) == std::future_status::timeout);
+	pool.release(first);
+	REQUIRE(second.wait_for(5s) == std::future_status::ready);
+	const auto second_regions = second.get();
+	CHECK(second_regions[0].offset == 0);
+	pool.release(second_regions);
+}
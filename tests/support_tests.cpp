@@ -48,6 +48,8 @@ TEST_CASE("formatting of types", "[format]") {
 		CHECK(utils::format("{}", device_id::host) == "host");
 		CHECK(utils::format("{}", device_id::d0) == "d0");
 		CHECK(utils::format("{}", device_id::d5) == "d5");
+		CHECK(utils::format("{}", make_device_id(12)) == "d12");
+		CHECK(utils::format("{}", device_id::none) == "none");
 	}
 	SECTION("staging_id") {
 		const staging_id id{true, device_id::d0, 42};
@@ -66,6 +68,7 @@ TEST_CASE("formatting of types", "[format]") {
 		CHECK(utils::format("{}", copy_properties::use_kernel) == "use_kernel");
 		CHECK(utils::format("{}", copy_properties::use_2D_copy) == "use_2D_copy");
 		CHECK(utils::format("{}", copy_properties::use_kernel | copy_properties::use_2D_copy) == "use_kernel,use_2D_copy");
+		CHECK(utils::format("{}", copy_properties::use_kernel | copy_properties::use_zero_copy) == "use_kernel,use_zero_copy");
 	}
 	SECTION("copy_spec") {
 		const copy_spec spec{device_id::d0, {0, 42, 1024, 1, 1024}, device_id::d1, {0xdead0000, 0, 256, 4, 320}};
@@ -78,6 +81,12 @@ TEST_CASE("formatting of types", "[format]") {
 		CHECK(utils::format("{}", copy_type::direct) == "direct");
 		CHECK(utils::format("{}", copy_type::staged) == "staged");
 	}
+	SECTION("memory_kind") {
+		CHECK(utils::format("{}", memory_kind::device) == "device");
+		CHECK(utils::format("{}", memory_kind::host_pinned) == "host_pinned");
+		CHECK(utils::format("{}", memory_kind::host_pageable) == "host_pageable");
+		CHECK(utils::format("{}", memory_kind::shared) == "shared");
+	}
 	SECTION("d2d_implementation") {
 		CHECK(utils::format("{}", d2d_implementation::direct) == "direct");
 		CHECK(utils::format("{}", d2d_implementation::host_staging_at_source) == "host_staging_at_source");
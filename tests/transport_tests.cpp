@@ -0,0 +1,89 @@
+#include "copylib_transport.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace copylib;
+
+namespace {
+std::string get_test_transport_name() { return "/copylib-test-" + std::to_string(getpid()); }
+} // namespace
+
+TEST_CASE("shared memory transports pass a stream through their slots in order", "[transport]") {
+	const int64_t slot_count = GENERATE(1, 2, 8);
+	CAPTURE(slot_count);
+	const auto name = get_test_transport_name();
+	shm_transport receiver(name, slot_count, 1000);
+	CHECK(receiver.get_slot_count() == slot_count);
+	CHECK(receiver.get_slot_size() >= 1000);
+	CHECK(receiver.get_slot_memory_size() == slot_count * receiver.get_slot_size());
+
+	// a stream not evenly divided by the slots, sent from another thread through a second mapping, as another process would
+	const int64_t stream_size = 100 * receiver.get_slot_size() + 123;
+	std::thread sender_thread([&] {
+		shm_transport sender(name);
+		for(int64_t offset = 0; offset < stream_size; offset += sender.get_slot_size()) {
+			const auto bytes = std::min(sender.get_slot_size(), stream_size - offset);
+			auto slot = reinterpret_cast<uint8_t*>(sender.acquire_send_slot());
+			for(int64_t i = 0; i < bytes; i++) {
+				slot[i] = static_cast<uint8_t>((offset + i) % 251);
+			}
+			sender.commit_send_slot(offset, bytes);
+		}
+	});
+
+	int64_t received = 0;
+	bool valid = true;
+	while(received < stream_size) {
+		const auto slot = receiver.acquire_receive_slot();
+		CHECK(slot.stream_offset == received);
+		const auto data = reinterpret_cast<const uint8_t*>(slot.data);
+		for(int64_t i = 0; i < slot.bytes; i++) {
+			valid &= data[i] == static_cast<uint8_t>((received + i) % 251);
+		}
+		received += slot.bytes;
+		receiver.release_receive_slot();
+	}
+	sender_thread.join();
+	CHECK(valid);
+	CHECK(received == stream_size);
+}
+
+TEST_CASE("shared memory transports are removed by their creator", "[transport]") {
+	const auto name = get_test_transport_name();
+	{
+		shm_transport transport(name, 4, 4096);
+		const shm_transport opened(name);
+		CHECK(opened.get_slot_count() == 4);
+		CHECK(opened.get_slot_size() == 4096);
+	}
+	// the name can be reused once the creator is gone
+	shm_transport transport(name, 2, 4096);
+	CHECK(transport.get_slot_count() == 2);
+}
+
+TEST_CASE("shared memory transports can be opened before their creator has set them up", "[transport]") {
+	const auto name = get_test_transport_name();
+	CHECK(shm_transport::try_open(name) == nullptr);
+
+	// the opener waits for the creator, which comes along later
+	int64_t opened_slot_count = 0;
+	std::thread opener([&] {
+		const shm_transport opened(name);
+		opened_slot_count = opened.get_slot_count();
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	const shm_transport transport(name, 8, 4096);
+	opener.join();
+	CHECK(opened_slot_count == 8);
+
+	const auto opened = shm_transport::try_open(name);
+	REQUIRE(opened != nullptr);
+	CHECK(opened->get_slot_count() == 8);
+}